@@ -0,0 +1,322 @@
+/***************************************************************
+ *
+ * MODULE:       v.rmarea
+ *
+ * AUTHOR(S):    Markus Metz
+ *
+ * PURPOSE:      Adjacency graph of areas with shared boundary lengths
+ *
+ * COPYRIGHT:    (C) 2024 by the GRASS Development Team
+ *
+ *               This program is free software under the
+ *               GNU General Public License (>=v2).
+ *               Read the file COPYING that comes with GRASS
+ *               for details.
+ *
+ **************************************************************/
+#include <stdlib.h>
+#include <string.h>
+
+#include <grass/gis.h>
+#include <grass/vector.h>
+#include <grass/glocale.h>
+
+#include "proto.h"
+
+/* The edges of all areas are stored in one array, the edges of an area are
+ * consecutive. The shared boundaries of all edges are stored in another
+ * array, the boundaries of an edge are consecutive. When an area is
+ * rebuilt, its new edges are appended and the old ones become garbage
+ * which is removed once it dominates the arrays. */
+
+static void graph_alloc_areas(struct area_graph *g, int area)
+{
+    int i, alloc;
+
+    if (area < g->alloc_areas)
+        return;
+
+    alloc = g->alloc_areas;
+    g->alloc_areas = area + 1000 + g->alloc_areas / 2;
+    g->first = G_realloc(g->first, g->alloc_areas * sizeof(int));
+    g->nedges = G_realloc(g->nedges, g->alloc_areas * sizeof(int));
+    for (i = alloc; i < g->alloc_areas; i++) {
+        g->first[i] = -1;
+        g->nedges[i] = 0;
+    }
+}
+
+static void graph_alloc_lines(struct area_graph *g, int line)
+{
+    int i, alloc;
+
+    if (line < g->alloc_line_length)
+        return;
+
+    alloc = g->alloc_line_length;
+    g->alloc_line_length = line + 1000 + g->alloc_line_length / 2;
+    g->line_length =
+        G_realloc(g->line_length, g->alloc_line_length * sizeof(double));
+    for (i = alloc; i < g->alloc_line_length; i++)
+        g->line_length[i] = -1;
+}
+
+double graph_line_length(struct area_graph *g, int line)
+{
+    line = abs(line);
+
+    graph_alloc_lines(g, line);
+    if (g->line_length[line] < 0) {
+        Vect_read_line(g->Map, g->Points, NULL, line);
+        g->line_length[line] = Vect_line_length(g->Points);
+    }
+
+    return g->line_length[line];
+}
+
+/* cached length of a boundary, < 0 if not yet known */
+double graph_known_line_length(const struct area_graph *g, int line)
+{
+    line = abs(line);
+
+    return line < g->alloc_line_length ? g->line_length[line] : -1;
+}
+
+/* store the length of a boundary computed elsewhere */
+void graph_set_line_length(struct area_graph *g, int line, double length)
+{
+    line = abs(line);
+
+    graph_alloc_lines(g, line);
+    g->line_length[line] = length;
+}
+
+/* remove garbage from edges and lines */
+static void graph_compact(struct area_graph *g)
+{
+    int area, i, n_edges, n_lines;
+    struct adj_edge *edges;
+    int *lines;
+
+    G_debug(2, "compact area graph: %d of %d edges are garbage",
+            g->garbage_edges, g->n_edges);
+
+    edges = G_malloc((g->n_edges - g->garbage_edges + 1) *
+                     sizeof(struct adj_edge));
+    lines = G_malloc((g->n_lines - g->garbage_lines + 1) * sizeof(int));
+    n_edges = n_lines = 0;
+    for (area = 1; area < g->alloc_areas; area++) {
+        if (g->first[area] < 0)
+            continue;
+
+        for (i = 0; i < g->nedges[area]; i++) {
+            struct adj_edge *e = &g->edges[g->first[area] + i];
+
+            memcpy(&lines[n_lines], &g->lines[e->first],
+                   e->nlines * sizeof(int));
+            edges[n_edges + i] = *e;
+            edges[n_edges + i].first = n_lines;
+            n_lines += e->nlines;
+        }
+        g->first[area] = n_edges;
+        n_edges += g->nedges[area];
+    }
+    G_free(g->edges);
+    G_free(g->lines);
+    g->edges = edges;
+    g->lines = lines;
+    g->n_edges = g->alloc_edges = n_edges;
+    g->n_lines = g->alloc_lines = n_lines;
+    g->garbage_edges = g->garbage_lines = 0;
+}
+
+/* append the edges of an area */
+static void graph_build_area(struct area_graph *g, int area)
+{
+    struct Map_info *Map = g->Map;
+    struct ilist *List = g->List;
+    int i, j, line, left, right, neighbour, first, nedges, nlines;
+
+    Vect_get_area_boundaries(Map, area, List);
+
+    if (List->n_values >= g->alloc_line_edge) {
+        g->alloc_line_edge = List->n_values + 100;
+        g->line_edge =
+            G_realloc(g->line_edge, g->alloc_line_edge * sizeof(int));
+    }
+
+    if (g->n_edges + List->n_values >= g->alloc_edges) {
+        if (g->garbage_edges > g->n_edges / 2)
+            graph_compact(g);
+        if (g->n_edges + List->n_values >= g->alloc_edges) {
+            g->alloc_edges =
+                g->n_edges + List->n_values + 1000 + g->alloc_edges / 2;
+            g->edges = G_realloc(g->edges,
+                                 g->alloc_edges * sizeof(struct adj_edge));
+        }
+    }
+    if (g->n_lines + List->n_values >= g->alloc_lines) {
+        g->alloc_lines =
+            g->n_lines + List->n_values + 1000 + g->alloc_lines / 2;
+        g->lines = G_realloc(g->lines, g->alloc_lines * sizeof(int));
+    }
+
+    /* group boundaries by neighbour, in order of first appearance */
+    first = g->n_edges;
+    nedges = 0;
+    nbmap_reset(&g->nbmap, List->n_values);
+    for (i = 0; i < List->n_values; i++) {
+        struct adj_edge *e;
+
+        line = List->value[i];
+
+        if (!Vect_line_alive(Map, abs(line))) /* Should not happen */
+            G_fatal_error(_("Area is composed of dead boundary"));
+
+        Vect_get_line_areas(Map, abs(line), &left, &right);
+        if (line > 0)
+            neighbour = left;
+        else
+            neighbour = right;
+
+        j = nbmap_index(&g->nbmap, neighbour);
+        e = &g->edges[first + j];
+        if (j == nedges) {
+            e->neighbour = neighbour;
+            e->length = 0;
+            e->nlines = 0;
+            nedges++;
+        }
+        e->length += graph_line_length(g, line);
+        e->nlines++;
+        g->line_edge[i] = j;
+    }
+
+    /* place the boundaries of each edge */
+    nlines = g->n_lines;
+    for (j = 0; j < nedges; j++) {
+        struct adj_edge *e = &g->edges[first + j];
+
+        e->first = nlines;
+        nlines += e->nlines;
+        e->nlines = 0;
+    }
+    for (i = 0; i < List->n_values; i++) {
+        struct adj_edge *e = &g->edges[first + g->line_edge[i]];
+
+        g->lines[e->first + e->nlines] = List->value[i];
+        e->nlines++;
+    }
+
+    g->first[area] = first;
+    g->nedges[area] = nedges;
+    g->n_edges += nedges;
+    g->n_lines = nlines;
+}
+
+/*!
+   \brief Build the adjacency graph of all areas
+
+   Boundary lengths are read in one pass over all boundaries, afterwards
+   the graph is built from topology only.
+
+   With lazy, nothing is built yet. The edges of an area and the lengths
+   of its boundaries are then built by graph_get_edges() when first
+   requested, e.g. if only few areas will be checked.
+ */
+void graph_init(struct area_graph *g, struct Map_info *Map, int lazy)
+{
+    int line, nlines, area, nareas;
+
+    memset(g, 0, sizeof(struct area_graph));
+    g->Map = Map;
+    g->List = Vect_new_list();
+    g->Points = Vect_new_line_struct();
+    nbmap_init(&g->nbmap);
+
+    nlines = Vect_get_num_lines(Map);
+    graph_alloc_lines(g, nlines);
+    nareas = Vect_get_num_areas(Map);
+    graph_alloc_areas(g, nareas);
+    if (lazy)
+        return;
+
+    G_message(_("Building area adjacency graph..."));
+
+    for (line = 1; line <= nlines; line++) {
+        G_percent(line, nlines, 2);
+        if (!Vect_line_alive(Map, line))
+            continue;
+        if (Vect_get_line_type(Map, line) != GV_BOUNDARY)
+            continue;
+        graph_line_length(g, line);
+    }
+
+    for (area = 1; area <= nareas; area++) {
+        if (!Vect_area_alive(Map, area))
+            continue;
+        graph_build_area(g, area);
+    }
+}
+
+void graph_free(struct area_graph *g)
+{
+    G_free(g->first);
+    G_free(g->nedges);
+    G_free(g->edges);
+    G_free(g->lines);
+    G_free(g->line_length);
+    G_free(g->line_edge);
+    nbmap_free(&g->nbmap);
+    Vect_destroy_list(g->List);
+    Vect_destroy_line_struct(g->Points);
+    memset(g, 0, sizeof(struct area_graph));
+}
+
+/*!
+   \brief Mark the edges of an area as outdated
+
+   Must be called for all areas whose boundaries or neighbours changed.
+ */
+void graph_invalidate(struct area_graph *g, int area)
+{
+    int i;
+
+    if (area <= 0 || area >= g->alloc_areas || g->first[area] < 0)
+        return;
+
+    for (i = 0; i < g->nedges[area]; i++)
+        g->garbage_lines += g->edges[g->first[area] + i].nlines;
+    g->garbage_edges += g->nedges[area];
+    g->first[area] = -1;
+    g->nedges[area] = 0;
+}
+
+/*!
+   \brief Get the edges of an area, rebuilt if outdated
+
+   The returned pointer is valid until the edges of another area are
+   rebuilt.
+
+   \return pointer to the first edge, NULL if the area has no edges
+ */
+const struct adj_edge *graph_get_edges(struct area_graph *g, int area,
+                                       int *nedges)
+{
+    graph_alloc_areas(g, area);
+    if (g->first[area] < 0)
+        graph_build_area(g, area);
+
+    *nedges = g->nedges[area];
+    if (*nedges == 0)
+        return NULL;
+
+    return &g->edges[g->first[area]];
+}
+
+/* shared boundaries of an edge */
+const int *graph_edge_lines(const struct area_graph *g,
+                            const struct adj_edge *e)
+{
+    return &g->lines[e->first];
+}
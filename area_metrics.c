@@ -0,0 +1,492 @@
+/***************************************************************
+ *
+ * MODULE:       v.rmarea
+ *
+ * AUTHOR(S):    Markus Metz
+ *
+ * PURPOSE:      Cached size, perimeter and category of areas
+ *
+ * COPYRIGHT:    (C) 2024 by the GRASS Development Team
+ *
+ *               This program is free software under the
+ *               GNU General Public License (>=v2).
+ *               Read the file COPYING that comes with GRASS
+ *               for details.
+ *
+ **************************************************************/
+#include <stdlib.h>
+#include <string.h>
+
+#include <grass/gis.h>
+#include <grass/vector.h>
+#include <grass/glocale.h>
+
+#include "proto.h"
+
+/*!
+   \brief Get the metrics of an area
+
+   The table grows as needed, metrics of unknown areas are empty.
+   The returned pointer is valid until metrics of a new area are requested.
+ */
+struct area_info *metrics_get(struct area_metrics *m, int area)
+{
+    if (area >= m->alloc) {
+        int i, alloc = m->alloc;
+
+        m->alloc = area + 1000 + m->alloc / 2;
+        m->info = G_realloc(m->info, m->alloc * sizeof(struct area_info));
+        m->known = G_realloc(m->known, m->alloc);
+        for (i = alloc; i < m->alloc; i++) {
+            m->info[i].size = 0;
+            m->info[i].perimeter = 0;
+            m->info[i].cat = -1;
+            m->info[i].cls = -1;
+            m->known[i] = 0;
+        }
+    }
+
+    return &m->info[area];
+}
+
+/* size computed before, < 0 if not known */
+static double known_size(const struct area_metrics *m, int area)
+{
+    /* areas are never renumbered, an area with an old id is unchanged */
+    if (m->sizes && area <= m->nsizes)
+        return m->sizes[area];
+
+    return -1;
+}
+
+/* perimeter including isles */
+static void compute_perimeter(struct area_metrics *m, int area)
+{
+    struct area_info *info = metrics_get(m, area);
+    const struct adj_edge *edges;
+    int i, j, nedges, nisles;
+
+    info->perimeter = 0;
+    edges = graph_get_edges(m->graph, area, &nedges);
+    for (i = 0; i < nedges; i++)
+        info->perimeter += edges[i].length;
+    nisles = Vect_get_area_num_isles(m->Map, area);
+    for (i = 0; i < nisles; i++) {
+        Vect_get_isle_boundaries(m->Map, Vect_get_area_isle(m->Map, area, i),
+                                 m->List);
+        for (j = 0; j < m->List->n_values; j++)
+            info->perimeter += graph_line_length(m->graph, m->List->value[j]);
+    }
+}
+
+/* size and perimeter including isles */
+static void compute_size(struct area_metrics *m, int area)
+{
+    struct area_info *info = metrics_get(m, area);
+
+    info->size = known_size(m, area);
+    if (info->size < 0)
+        info->size = Vect_get_area_area(m->Map, area);
+    compute_perimeter(m, area);
+}
+
+/* category and attribute class from the centroid */
+static void read_cat(struct area_metrics *m, int area)
+{
+    struct area_info *info = metrics_get(m, area);
+    int centroid;
+
+    centroid = Vect_get_area_centroid(m->Map, area);
+    if (centroid > 0) {
+        Vect_read_line(m->Map, NULL, m->Cats, centroid);
+        Vect_cat_get(m->Cats, m->layer, &info->cat);
+        if (info->cat >= 0)
+            info->cls = attr_class_get(m->classes, info->cat);
+    }
+}
+
+/*!
+   \brief Fill the metrics of all areas or prepare to compute them on demand
+
+   Sizes are computed once per area, categories are read in one pass
+   over the centroids, perimeters including isles are taken from the
+   cached boundary lengths.
+
+   Sizes computed before for the same map, e.g. by get_candidate_cats(),
+   are taken from sizes if not NULL.
+
+   With lazy, nothing is computed yet. The metrics of an area must then be
+   computed with metrics_compute() before they are read, e.g. if only few
+   areas will be checked.
+ */
+void metrics_init(struct area_metrics *m, struct Map_info *Map,
+                  struct area_graph *graph, int layer,
+                  const struct attr_classes *classes, const double *sizes,
+                  int lazy)
+{
+    int area, nareas, line, nlines;
+    struct area_info *info;
+
+    m->info = NULL;
+    m->known = NULL;
+    m->alloc = 0;
+    m->Map = Map;
+    m->graph = graph;
+    m->layer = layer;
+    m->classes = classes;
+    m->List = Vect_new_list();
+    m->Cats = Vect_new_cats_struct();
+
+    nareas = Vect_get_num_areas(Map);
+    m->sizes = sizes;
+    m->nsizes = nareas;
+    metrics_get(m, nareas);
+    if (lazy)
+        return;
+
+    G_message(_("Computing area sizes..."));
+
+    for (area = 1; area <= nareas; area++) {
+        G_percent(area, nareas, 2);
+        if (!Vect_area_alive(Map, area))
+            continue;
+
+        compute_size(m, area);
+        m->known[area] = 1;
+    }
+
+    nlines = Vect_get_num_lines(Map);
+    for (line = 1; line <= nlines; line++) {
+        if (!Vect_line_alive(Map, line))
+            continue;
+        if (Vect_get_line_type(Map, line) != GV_CENTROID)
+            continue;
+
+        area = Vect_get_centroid_area(Map, line);
+        if (area <= 0)
+            continue;
+
+        Vect_read_line(Map, NULL, m->Cats, line);
+        info = metrics_get(m, area);
+        Vect_cat_get(m->Cats, layer, &info->cat);
+        if (info->cat >= 0)
+            info->cls = attr_class_get(classes, info->cat);
+    }
+}
+
+/*!
+   \brief Compute the metrics of an area if not yet known
+
+   Not thread safe, the metrics of all areas read in parallel must be
+   computed before.
+ */
+void metrics_compute(struct area_metrics *m, int area)
+{
+    if (area <= 0)
+        return;
+    metrics_get(m, area);
+    if (m->known[area] || !Vect_area_alive(m->Map, area))
+        return;
+
+    compute_size(m, area);
+    read_cat(m, area);
+    m->known[area] = 1;
+}
+
+/* areas of a batch are processed in chunks of this size, which bounds the
+ * geometry held in memory at a time */
+#define CHUNK 1024
+
+/* boundaries of the areas of a chunk */
+struct chunk {
+    int *lines;                /* boundaries to read */
+    struct line_pnts **Points; /* geometry of each boundary */
+    double *length;            /* length of each boundary */
+    int nlines, alloc_lines;
+    int *slot;                 /* index of a boundary in lines, -1 if none */
+    int *rings;                /* ring boundaries as index in lines,
+                                  -index - 1 if backwards */
+    int nrings, alloc_rings;
+    int ring_first[CHUNK + 1]; /* first boundary of the outer ring */
+    int ring_isles[CHUNK + 1]; /* first boundary of the isles */
+    int *isle_first;           /* first boundary of each isle ring */
+    int nisles, alloc_isles;
+    int area_isle[CHUNK + 1];  /* first isle ring of an area */
+    double size[CHUNK];
+};
+
+/* add a boundary to the chunk, return its index */
+static int chunk_add_line(struct chunk *c, int line)
+{
+    line = abs(line);
+    if (c->slot[line] >= 0)
+        return c->slot[line];
+
+    if (c->nlines == c->alloc_lines) {
+        c->alloc_lines += 1000 + c->alloc_lines / 2;
+        c->lines = G_realloc(c->lines, c->alloc_lines * sizeof(int));
+        c->length = G_realloc(c->length, c->alloc_lines * sizeof(double));
+        c->Points = G_realloc(c->Points,
+                              c->alloc_lines * sizeof(struct line_pnts *));
+        memset(c->Points + c->nlines, 0,
+               (c->alloc_lines - c->nlines) * sizeof(struct line_pnts *));
+    }
+    c->lines[c->nlines] = line;
+    c->slot[line] = c->nlines;
+
+    return c->nlines++;
+}
+
+/* add the boundaries of a ring to the chunk */
+static void chunk_add_ring(struct chunk *c, const struct ilist *List)
+{
+    int i, k;
+
+    if (c->nrings + List->n_values > c->alloc_rings) {
+        c->alloc_rings = c->nrings + List->n_values + 1000 +
+                         c->alloc_rings / 2;
+        c->rings = G_realloc(c->rings, c->alloc_rings * sizeof(int));
+    }
+    for (i = 0; i < List->n_values; i++) {
+        k = chunk_add_line(c, List->value[i]);
+        c->rings[c->nrings++] = List->value[i] > 0 ? k : -k - 1;
+    }
+}
+
+/* area of a ring as computed by Vect_get_area_area() */
+static double ring_area(const struct chunk *c, int first, int last,
+                        struct line_pnts *Points)
+{
+    int i, k;
+
+    Vect_reset_line(Points);
+    for (i = first; i < last; i++) {
+        k = c->rings[i];
+        if (k >= 0)
+            Vect_append_points(Points, c->Points[k], GV_FORWARD);
+        else
+            Vect_append_points(Points, c->Points[-k - 1], GV_BACKWARD);
+        Points->n_points--; /* skip last point, avoids duplicates */
+    }
+    Points->n_points++; /* close polygon */
+    Vect_line_prune(Points);
+
+    return G_area_of_polygon(Points->x, Points->y, Points->n_points);
+}
+
+/* collect the boundaries of an area, with rings if its size is needed */
+static void chunk_add_area(struct chunk *c, struct area_metrics *m, int k,
+                           int area, int rings)
+{
+    struct ilist *List = m->List;
+    int i, j, nisles;
+
+    c->ring_first[k] = c->nrings;
+    c->area_isle[k] = c->nisles;
+
+    nisles = Vect_get_area_num_isles(m->Map, area);
+    for (j = -1; j < nisles; j++) {
+        if (j < 0)
+            Vect_get_area_boundaries(m->Map, area, List);
+        else
+            Vect_get_isle_boundaries(
+                m->Map, Vect_get_area_isle(m->Map, area, j), List);
+
+        if (rings) {
+            if (j < 0) {
+                chunk_add_ring(c, List);
+                c->ring_isles[k] = c->nrings;
+                continue;
+            }
+            if (c->nisles == c->alloc_isles) {
+                c->alloc_isles += 100 + c->alloc_isles / 2;
+                c->isle_first = G_realloc(c->isle_first,
+                                          c->alloc_isles * sizeof(int));
+            }
+            c->isle_first[c->nisles++] = c->nrings;
+            chunk_add_ring(c, List);
+        }
+        else {
+            /* only boundaries of unknown length */
+            for (i = 0; i < List->n_values; i++) {
+                if (graph_known_line_length(m->graph, List->value[i]) < 0)
+                    chunk_add_line(c, List->value[i]);
+            }
+        }
+    }
+    if (!rings)
+        c->ring_isles[k] = c->nrings;
+    c->ring_first[k + 1] = c->nrings;
+    c->area_isle[k + 1] = c->nisles;
+}
+
+static int cmp_int(const void *a, const void *b)
+{
+    int ia = *(const int *)a;
+    int ib = *(const int *)b;
+
+    return (ia > ib) - (ia < ib);
+}
+
+/*!
+   \brief Compute the metrics and adjacency of many areas
+
+   Computes the metrics of unknown areas and the edges of all areas as
+   metrics_compute() and graph_get_edges() would. The geometry of the
+   boundaries is read by one thread, lengths of boundaries and sizes of
+   areas are then computed in parallel from it. The results do not depend
+   on the number of threads.
+
+   \param areas areas, may contain duplicates and dead areas
+   \param n number of areas
+ */
+void metrics_compute_batch(struct area_metrics *m, const int *areas, int n)
+{
+    struct Map_info *Map = m->Map;
+    struct chunk c;
+    struct area_info *info;
+    int *sorted, i, j, k, nsorted, start, nchunk, nlines, nedges;
+
+    sorted = G_malloc((n + 1) * sizeof(int));
+    memcpy(sorted, areas, n * sizeof(int));
+    qsort(sorted, n, sizeof(int), cmp_int);
+    nsorted = 0;
+    for (i = 0; i < n; i++) {
+        if (sorted[i] <= 0 || !Vect_area_alive(Map, sorted[i]))
+            continue;
+        if (nsorted > 0 && sorted[nsorted - 1] == sorted[i])
+            continue;
+        sorted[nsorted++] = sorted[i];
+    }
+    if (nsorted > 0)
+        metrics_get(m, sorted[nsorted - 1]);
+
+    memset(&c, 0, sizeof(struct chunk));
+    nlines = Vect_get_num_lines(Map);
+    c.slot = G_malloc((nlines + 1) * sizeof(int));
+    for (i = 0; i <= nlines; i++)
+        c.slot[i] = -1;
+    G_begin_polygon_area_calculations();
+
+    for (start = 0; start < nsorted; start += CHUNK) {
+        nchunk = nsorted - start < CHUNK ? nsorted - start : CHUNK;
+        c.nlines = c.nrings = c.nisles = 0;
+
+        /* collect and read the boundaries, not thread safe */
+        for (k = 0; k < nchunk; k++) {
+            int area = sorted[start + k];
+
+            chunk_add_area(&c, m, k, area,
+                           !m->known[area] && known_size(m, area) < 0);
+        }
+        for (i = 0; i < c.nlines; i++) {
+            if (!c.Points[i])
+                c.Points[i] = Vect_new_line_struct();
+            Vect_read_line(Map, c.Points[i], NULL, c.lines[i]);
+        }
+
+        /* lengths and sizes, reading only the geometry of the chunk */
+#if defined(_OPENMP)
+#pragma omp parallel private(i, j, k)
+#endif
+        {
+            struct line_pnts *Points = Vect_new_line_struct();
+
+#if defined(_OPENMP)
+#pragma omp for schedule(dynamic, 64)
+#endif
+            for (i = 0; i < c.nlines; i++)
+                c.length[i] = Vect_line_length(c.Points[i]);
+
+#if defined(_OPENMP)
+#pragma omp for schedule(dynamic, 16)
+#endif
+            for (k = 0; k < nchunk; k++) {
+                if (c.ring_first[k] == c.ring_first[k + 1])
+                    continue;
+                c.size[k] =
+                    ring_area(&c, c.ring_first[k], c.ring_isles[k], Points);
+                for (j = c.area_isle[k]; j < c.area_isle[k + 1]; j++)
+                    c.size[k] -= ring_area(&c, c.isle_first[j],
+                                           j + 1 < c.area_isle[k + 1]
+                                               ? c.isle_first[j + 1]
+                                               : c.ring_first[k + 1],
+                                           Points);
+            }
+
+            Vect_destroy_line_struct(Points);
+        }
+
+        /* store the results, edges are built from topology only */
+        for (i = 0; i < c.nlines; i++) {
+            if (graph_known_line_length(m->graph, c.lines[i]) < 0)
+                graph_set_line_length(m->graph, c.lines[i], c.length[i]);
+            c.slot[c.lines[i]] = -1;
+        }
+        for (k = 0; k < nchunk; k++) {
+            int area = sorted[start + k];
+
+            graph_get_edges(m->graph, area, &nedges);
+            if (m->known[area])
+                continue;
+            info = metrics_get(m, area);
+            if (c.ring_first[k] < c.ring_first[k + 1])
+                info->size = c.size[k];
+            else
+                info->size = known_size(m, area);
+            compute_perimeter(m, area);
+            read_cat(m, area);
+            m->known[area] = 1;
+        }
+    }
+
+    for (i = 0; i < c.alloc_lines; i++) {
+        if (c.Points[i])
+            Vect_destroy_line_struct(c.Points[i]);
+    }
+    G_free(c.Points);
+    G_free(c.lines);
+    G_free(c.length);
+    G_free(c.slot);
+    G_free(c.rings);
+    G_free(c.isle_first);
+    G_free(sorted);
+}
+
+void metrics_free(struct area_metrics *m)
+{
+    G_free(m->info);
+    G_free(m->known);
+    m->info = NULL;
+    m->known = NULL;
+    m->alloc = 0;
+    Vect_destroy_list(m->List);
+    Vect_destroy_cats_struct(m->Cats);
+}
+
+/*!
+   \brief Update metrics after merging area a with area b
+
+   The merged area keeps the centroid of b. If to is b, area a was
+   merged through an isle of b.
+
+   \param to the merged area
+   \param a the removed area
+   \param b the area a was merged with
+   \param shared length of the deleted boundaries
+ */
+void metrics_merge(struct area_metrics *m, int to, int a, int b,
+                   double shared)
+{
+    struct area_info ia, ib, *it;
+
+    ia = *metrics_get(m, a);
+    ib = *metrics_get(m, b);
+    it = metrics_get(m, to);
+
+    it->size = ia.size + ib.size;
+    it->perimeter = ia.perimeter + ib.perimeter - 2 * shared;
+    it->cat = ib.cat;
+    it->cls = ib.cls;
+    m->known[to] = 1;
+}
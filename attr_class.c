@@ -0,0 +1,502 @@
+/***************************************************************
+ *
+ * MODULE:       v.rmarea
+ *
+ * AUTHOR(S):    Markus Metz
+ *
+ * PURPOSE:      Collapse attribute columns into attribute classes
+ *
+ * COPYRIGHT:    (C) 2024 by the GRASS Development Team
+ *
+ *               This program is free software under the
+ *               GNU General Public License (>=v2).
+ *               Read the file COPYING that comes with GRASS
+ *               for details.
+ *
+ **************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <grass/gis.h>
+#include <grass/vector.h>
+#include <grass/dbmi.h>
+#include <grass/glocale.h>
+
+#include "proto.h"
+
+/* Categories with identical values in all columns get the same class id,
+ * class ids are dense, starting with 0. Classes are found with a hash
+ * table over the value tuples, collisions are resolved by comparing the
+ * values. */
+
+#define HASH_EMPTY -1
+
+static unsigned int hash_bytes(unsigned int h, const void *p, size_t n)
+{
+    const unsigned char *c = p;
+
+    /* FNV-1a */
+    while (n--) {
+        h ^= *c++;
+        h *= 16777619u;
+    }
+
+    return h;
+}
+
+static unsigned int hash_value(unsigned int h, int ctype, dbCatVal *cv)
+{
+    if (cv == NULL || cv->isNull)
+        return hash_bytes(h, "", 1);
+
+    if (ctype == DB_C_TYPE_INT) {
+        h = hash_bytes(h, &cv->val.i, sizeof(int));
+    }
+    else if (ctype == DB_C_TYPE_DOUBLE) {
+        double d = cv->val.d;
+
+        if (d == 0)
+            d = 0; /* -0 == 0 */
+        h = hash_bytes(h, &d, sizeof(double));
+    }
+    else if (ctype == DB_C_TYPE_STRING) {
+        const char *s = db_get_string(cv->val.s);
+
+        if (s)
+            h = hash_bytes(h, s, strlen(s) + 1);
+    }
+
+    return h;
+}
+
+/* compare values
+ * return 0 identical
+ * return 1 not identical
+ */
+static int comp_value(int ctype, dbCatVal *a, dbCatVal *b)
+{
+    const char *as, *bs;
+    int anull, bnull;
+
+    anull = a == NULL || a->isNull;
+    bnull = b == NULL || b->isNull;
+    if (anull || bnull)
+        return anull != bnull;
+
+    if (ctype == DB_C_TYPE_INT)
+        return a->val.i != b->val.i;
+    if (ctype == DB_C_TYPE_DOUBLE)
+        return a->val.d != b->val.d;
+    if (ctype == DB_C_TYPE_STRING) {
+        as = db_get_string(a->val.s);
+        bs = db_get_string(b->val.s);
+        if (!as || !bs)
+            return as != bs;
+        return strcmp(as, bs) != 0;
+    }
+
+    return 1;
+}
+
+/*!
+   \brief Assign attribute classes to all categories
+
+   The categories are taken from the first column.
+   Columns of types other than integer, double and string
+   never compare identical, as before.
+
+   \param[out] ac attribute classes
+   \param cvarr values of the columns, sorted by category
+   \param ncols number of columns
+ */
+void attr_classes_build(struct attr_classes *ac, dbCatValArray *cvarr,
+                        int ncols)
+{
+    int i, k, col, n, hsize, supported;
+    int *hash_cls, *cls_rep;
+    dbCatVal ***vals;
+
+    ac->n = ac->nclasses = 0;
+    ac->cat = ac->cls = NULL;
+    if (ncols < 1 || cvarr[0].n_values == 0)
+        return;
+
+    supported = 1;
+    for (col = 0; col < ncols; col++) {
+        if (cvarr[col].ctype != DB_C_TYPE_INT &&
+            cvarr[col].ctype != DB_C_TYPE_DOUBLE &&
+            cvarr[col].ctype != DB_C_TYPE_STRING) {
+            G_warning(_("Unsupported column type, "
+                        "no areas will be considered as identical"));
+            supported = 0;
+        }
+    }
+
+    n = cvarr[0].n_values;
+    ac->n = n;
+    ac->cat = G_malloc(n * sizeof(int));
+    ac->cls = G_malloc(n * sizeof(int));
+
+    /* values of each column by index of the category in the first column */
+    vals = G_malloc(ncols * sizeof(dbCatVal **));
+    for (col = 0; col < ncols; col++) {
+        vals[col] = G_malloc(n * sizeof(dbCatVal *));
+        for (k = 0; k < n; k++) {
+            if (col == 0)
+                vals[col][k] = &cvarr[0].value[k];
+            else if (db_CatValArray_get_value(&cvarr[col],
+                                              cvarr[0].value[k].cat,
+                                              &vals[col][k]) != DB_OK)
+                vals[col][k] = NULL;
+        }
+    }
+
+    hsize = 1;
+    while (hsize < 2 * n)
+        hsize <<= 1;
+    hash_cls = G_malloc(hsize * sizeof(int));
+    for (i = 0; i < hsize; i++)
+        hash_cls[i] = HASH_EMPTY;
+    /* representative category index of each class */
+    cls_rep = G_malloc(n * sizeof(int));
+
+    for (k = 0; k < n; k++) {
+        unsigned int h = 2166136261u;
+
+        ac->cat[k] = cvarr[0].value[k].cat;
+
+        if (!supported) {
+            ac->cls[k] = ac->nclasses++;
+            continue;
+        }
+
+        for (col = 0; col < ncols; col++)
+            h = hash_value(h, cvarr[col].ctype, vals[col][k]);
+
+        i = h & (hsize - 1);
+        while (hash_cls[i] != HASH_EMPTY) {
+            int r = cls_rep[hash_cls[i]];
+
+            for (col = 0; col < ncols; col++) {
+                if (comp_value(cvarr[col].ctype, vals[col][k],
+                               vals[col][r]) != 0)
+                    break;
+            }
+            if (col == ncols)
+                break;
+            i = (i + 1) & (hsize - 1);
+        }
+        if (hash_cls[i] == HASH_EMPTY) {
+            hash_cls[i] = ac->nclasses;
+            cls_rep[ac->nclasses] = k;
+            ac->nclasses++;
+        }
+        ac->cls[k] = hash_cls[i];
+    }
+
+    G_verbose_message(_("%d categories in %d attribute classes"), n,
+                      ac->nclasses);
+
+    for (col = 0; col < ncols; col++)
+        G_free(vals[col]);
+    G_free(vals);
+    G_free(hash_cls);
+    G_free(cls_rep);
+}
+
+void attr_classes_free(struct attr_classes *ac)
+{
+    G_free(ac->cat);
+    G_free(ac->cls);
+    ac->cat = ac->cls = NULL;
+    ac->n = ac->nclasses = 0;
+}
+
+/*!
+   \brief Get the attribute class of a category
+
+   \return class id
+   \return -1 if the category has no attributes
+ */
+int attr_class_get(const struct attr_classes *ac, int cat)
+{
+    int lo, hi, mid;
+
+    lo = 0;
+    hi = ac->n - 1;
+    while (lo <= hi) {
+        mid = (lo + hi) / 2;
+        if (ac->cat[mid] == cat)
+            return ac->cls[mid];
+        if (ac->cat[mid] < cat)
+            lo = mid + 1;
+        else
+            hi = mid - 1;
+    }
+
+    return -1;
+}
+
+/*!
+   \brief Get attribute classes with a single query
+
+   The database ranks the categories by the tuple of column values,
+   instead of selecting each column separately. This requires support
+   for window functions (SQLite >= 3.25). NULL values compare identical.
+
+   \param[out] ac attribute classes
+   \param driver open database driver
+   \param table attribute table
+   \param key key column
+   \param columns names of the columns
+   \param ncols number of columns
+
+   \return DB_OK on success
+   \return DB_FAILED if the query failed
+ */
+int attr_classes_select(struct attr_classes *ac, dbDriver *driver,
+                        const char *table, const char *key, char **columns,
+                        int ncols)
+{
+    int col, more, alloc, cls;
+    dbString sql;
+    dbCursor cursor;
+    dbTable *result;
+    dbValue *value;
+
+    ac->n = ac->nclasses = 0;
+    ac->cat = ac->cls = NULL;
+
+    db_init_string(&sql);
+    db_set_string(&sql, "SELECT ");
+    db_append_string(&sql, key);
+    db_append_string(&sql, ", DENSE_RANK() OVER (ORDER BY ");
+    for (col = 0; col < ncols; col++) {
+        if (col > 0)
+            db_append_string(&sql, ", ");
+        db_append_string(&sql, columns[col]);
+    }
+    db_append_string(&sql, ") FROM ");
+    db_append_string(&sql, table);
+    db_append_string(&sql, " ORDER BY ");
+    db_append_string(&sql, key);
+    G_debug(1, "SQL: %s", db_get_string(&sql));
+
+    if (db_open_select_cursor(driver, &sql, &cursor, DB_SEQUENTIAL) !=
+        DB_OK) {
+        db_free_string(&sql);
+        return DB_FAILED;
+    }
+    db_free_string(&sql);
+    result = db_get_cursor_table(&cursor);
+
+    alloc = 0;
+    while (1) {
+        if (db_fetch(&cursor, DB_NEXT, &more) != DB_OK) {
+            db_close_cursor(&cursor);
+            attr_classes_free(ac);
+            return DB_FAILED;
+        }
+        if (!more)
+            break;
+
+        value = db_get_column_value(db_get_table_column(result, 0));
+        if (db_test_value_isnull(value))
+            continue;
+
+        if (ac->n >= alloc) {
+            alloc = alloc + 1000 + alloc / 2;
+            ac->cat = G_realloc(ac->cat, alloc * sizeof(int));
+            ac->cls = G_realloc(ac->cls, alloc * sizeof(int));
+        }
+        ac->cat[ac->n] = db_get_value_int(value);
+        /* ranks start with 1, class ids with 0 */
+        value = db_get_column_value(db_get_table_column(result, 1));
+        cls = db_get_value_int(value) - 1;
+        ac->cls[ac->n] = cls;
+        if (cls >= ac->nclasses)
+            ac->nclasses = cls + 1;
+        ac->n++;
+    }
+    db_close_cursor(&cursor);
+
+    G_verbose_message(_("%d categories in %d attribute classes"), ac->n,
+                      ac->nclasses);
+
+    return DB_OK;
+}
+
+/* categories per query if only some categories are selected */
+#define CATS_PER_QUERY 1000
+
+/* select the values of a column for the given categories in batches,
+ * return number of selected values or -1 on error, cvarr is freed then */
+static int select_column(dbDriver *driver, const struct field_info *Fi,
+                         const char *column, const struct ilist *cats,
+                         dbCatValArray *cvarr)
+{
+    int i, first, nrec;
+    char buf[64];
+    dbString where;
+    dbCatValArray batch;
+
+    db_CatValArray_init(cvarr);
+    if (!cats) {
+        nrec = db_select_CatValArray(driver, Fi->table, Fi->key, column,
+                                     NULL, cvarr);
+        if (nrec < 0)
+            db_CatValArray_free(cvarr);
+        return nrec;
+    }
+
+    db_init_string(&where);
+    for (first = 0; first < cats->n_values; first += CATS_PER_QUERY) {
+        db_set_string(&where, Fi->key);
+        db_append_string(&where, " IN (");
+        for (i = first;
+             i < cats->n_values && i < first + CATS_PER_QUERY; i++) {
+            sprintf(buf, i > first ? ",%d" : "%d", cats->value[i]);
+            db_append_string(&where, buf);
+        }
+        db_append_string(&where, ")");
+
+        db_CatValArray_init(&batch);
+        nrec = db_select_CatValArray(driver, Fi->table, Fi->key, column,
+                                     db_get_string(&where), &batch);
+        if (nrec < 0) {
+            db_CatValArray_free(&batch);
+            db_CatValArray_free(cvarr);
+            db_free_string(&where);
+            return -1;
+        }
+
+        /* move the values, strings are now owned by cvarr */
+        cvarr->ctype = batch.ctype;
+        if (cvarr->n_values + batch.n_values > cvarr->alloc)
+            db_CatValArray_realloc(cvarr, cvarr->n_values + batch.n_values +
+                                              cats->n_values - i);
+        memcpy(cvarr->value + cvarr->n_values, batch.value,
+               batch.n_values * sizeof(dbCatVal));
+        cvarr->n_values += batch.n_values;
+        batch.n_values = 0;
+        db_CatValArray_free(&batch);
+    }
+    db_free_string(&where);
+    db_CatValArray_sort(cvarr);
+
+    return cvarr->n_values;
+}
+
+/*!
+   \brief Load the attribute classes of a layer
+
+   \param[out] ac attribute classes
+   \param Fi database connection of the layer
+   \param columns names of the columns
+   \param ncols number of columns
+   \param in_db compute classes in the database with a single query,
+   ignored if a column is not of integer, double or string type
+   \param cats sorted categories to load or NULL to load all categories,
+   ignored with in_db
+   \param stats the time spent comparing values is added or NULL
+ */
+void attr_classes_load(struct attr_classes *ac, const struct field_info *Fi,
+                       char **columns, int ncols, int in_db,
+                       const struct ilist *cats, struct rmarea_stats *stats)
+{
+    int i, j, col, ncols_table, nrec;
+    double t;
+    const char *colname;
+    dbDriver *driver;
+    dbString table_name;
+    dbTable *table;
+    dbCatValArray *cvarr;
+
+    driver = db_start_driver_open_database(Fi->driver, Fi->database);
+    db_init_string(&table_name);
+    db_set_string(&table_name, Fi->table);
+    if (db_describe_table(driver, &table_name, &table) != DB_OK)
+        G_fatal_error(_("Unable to describe table <%s>"), Fi->table);
+
+    ncols_table = db_get_table_number_of_columns(table);
+    cvarr = G_malloc(sizeof(dbCatValArray) * ncols);
+
+    G_debug(1, "Number of columns in table: %d", ncols_table);
+
+    /* the database would rank values of other types as identical,
+     * attr_classes_build() keeps them different */
+    for (col = 0; in_db && col < ncols_table; col++) {
+        dbColumn *column = db_get_table_column(table, col);
+        int ctype = db_sqltype_to_Ctype(db_get_column_sqltype(column));
+
+        colname = db_get_column_name(column);
+        for (j = 0; j < ncols; j++) {
+            if (strcmp(colname, columns[j]) == 0 &&
+                ctype != DB_C_TYPE_INT && ctype != DB_C_TYPE_DOUBLE &&
+                ctype != DB_C_TYPE_STRING) {
+                G_verbose_message(_("Column <%s> can not be compared in "
+                                    "the database"),
+                                  colname);
+                in_db = 0;
+                break;
+            }
+        }
+    }
+
+    if (cats && !in_db)
+        G_message("Copy attributes for %d columns of %d categories ...",
+                  ncols, cats->n_values);
+    else
+        G_message("Copy attributes for %d columns ...", ncols);
+
+    i = 0;
+    for (col = 0; col < ncols_table; col++) {
+        int use_col = 0;
+
+        colname = db_get_column_name(db_get_table_column(table, col));
+        for (j = 0; j < ncols; j++) {
+            if (strcmp(colname, columns[j]) == 0) {
+                use_col = 1;
+                break;
+            }
+        }
+
+        if (use_col && in_db) {
+            /* selected all at once below */
+            i++;
+        }
+        else if (use_col) {
+            nrec = select_column(driver, Fi, colname, cats, &cvarr[i]);
+            if (nrec < 0)
+                G_fatal_error(_("Unable to select data from table <%s>"),
+                              Fi->table);
+            i++;
+        }
+    }
+
+    if (i < ncols)
+        G_fatal_error(_("Not all columns found in table <%s>"), Fi->table);
+
+    /* only one class id per category is needed for comparisons, all
+     * values are compared here */
+    t = timer_now();
+    if (in_db) {
+        if (attr_classes_select(ac, driver, Fi->table, Fi->key, columns,
+                                ncols) != DB_OK)
+            G_fatal_error(_("Unable to select attribute classes from "
+                            "table <%s>"),
+                          Fi->table);
+    }
+    else {
+        attr_classes_build(ac, cvarr, ncols);
+        for (i = 0; i < ncols; i++)
+            db_CatValArray_free(&cvarr[i]);
+    }
+    if (stats)
+        stats->attr_time += timer_now() - t;
+    G_free(cvarr);
+    db_free_string(&table_name);
+
+    db_close_database_shutdown_driver(driver);
+}
@@ -0,0 +1,196 @@
+/***************************************************************
+ *
+ * MODULE:       v.rmarea
+ *
+ * AUTHOR(S):    Markus Metz
+ *
+ * PURPOSE:      Find the areas and categories to be checked
+ *
+ * COPYRIGHT:    (C) 2024 by the GRASS Development Team
+ *
+ *               This program is free software under the
+ *               GNU General Public License (>=v2).
+ *               Read the file COPYING that comes with GRASS
+ *               for details.
+ *
+ **************************************************************/
+#include <stdlib.h>
+
+#include <grass/gis.h>
+#include <grass/vector.h>
+#include <grass/glocale.h>
+
+#include "proto.h"
+
+static int cmp_int(const void *a, const void *b)
+{
+    int ia = *(const int *)a;
+    int ib = *(const int *)b;
+
+    return (ia > ib) - (ia < ib);
+}
+
+static void add_area_cat(struct Map_info *Map, int area, int layer,
+                         struct line_cats *Cats, struct ilist *List)
+{
+    int centroid, cat;
+
+    if (area <= 0)
+        return;
+    centroid = Vect_get_area_centroid(Map, area);
+    if (centroid <= 0)
+        return;
+
+    Vect_read_line(Map, NULL, Cats, centroid);
+    if (Vect_cat_get(Cats, layer, &cat))
+        G_ilist_add(List, cat);
+}
+
+/*!
+   \brief Get the categories of small areas and their neighbours
+
+   Merges only grow areas, and a merged area keeps the category of an
+   area adjacent to a small area. Therefore only attributes of these
+   categories are ever compared.
+
+   The sizes of all areas are computed here anyway, with sizes they are
+   returned by area id (-1 for dead areas) so that they need not be
+   computed again.
+
+   \param Map vector map with topology
+   \param layer layer number
+   \param thresh size threshold of small areas
+   \param[out] sizes allocated array of area sizes or NULL
+
+   \return sorted list of unique categories
+ */
+struct ilist *get_candidate_cats(struct Map_info *Map, int layer,
+                                 double thresh, double **sizes)
+{
+    int area, nareas, i, n, line, left, right, neighbour, nsmall;
+    double size;
+    struct ilist *List, *Boundaries;
+    struct line_cats *Cats;
+
+    List = G_new_ilist();
+    Boundaries = Vect_new_list();
+    Cats = Vect_new_cats_struct();
+
+    G_message(_("Searching small areas..."));
+
+    nsmall = 0;
+    nareas = Vect_get_num_areas(Map);
+    if (sizes)
+        *sizes = G_malloc((nareas + 1) * sizeof(double));
+    for (area = 1; area <= nareas; area++) {
+        G_percent(area, nareas, 2);
+        if (sizes)
+            (*sizes)[area] = -1;
+        if (!Vect_area_alive(Map, area))
+            continue;
+        if (sizes) {
+            size = Vect_get_area_area(Map, area);
+            (*sizes)[area] = size;
+        }
+        if (!Vect_get_area_centroid(Map, area))
+            continue;
+        if (!sizes)
+            size = Vect_get_area_area(Map, area);
+        if (size > thresh)
+            continue;
+
+        nsmall++;
+        add_area_cat(Map, area, layer, Cats, List);
+
+        Vect_get_area_boundaries(Map, area, Boundaries);
+        for (i = 0; i < Boundaries->n_values; i++) {
+            line = Boundaries->value[i];
+            Vect_get_line_areas(Map, abs(line), &left, &right);
+            neighbour = line > 0 ? left : right;
+            if (neighbour < 0)
+                neighbour = Vect_get_isle_area(Map, -neighbour);
+            add_area_cat(Map, neighbour, layer, Cats, List);
+        }
+    }
+
+    qsort(List->value, List->n_values, sizeof(int), cmp_int);
+    n = 0;
+    for (i = 0; i < List->n_values; i++) {
+        if (n > 0 && List->value[i] == List->value[n - 1])
+            continue;
+        List->value[n++] = List->value[i];
+    }
+    List->n_values = n;
+
+    G_verbose_message(_("%d small areas with %d categories to compare"),
+                      nsmall, n);
+
+    Vect_destroy_list(Boundaries);
+    Vect_destroy_cats_struct(Cats);
+
+    return List;
+}
+
+/*!
+   \brief Get the areas changed since a previous run
+
+   Areas with a category in the list and areas overlapping one of the
+   boxes are returned. Only these areas and their neighbours need to be
+   checked again in a map from which small areas were already removed.
+
+   \param Map vector map with topology and category index
+   \param layer layer number
+   \param cats changed categories or NULL
+   \param boxes changed regions
+   \param nboxes number of changed regions
+
+   \return list of unique area ids
+ */
+struct ilist *get_changed_areas(struct Map_info *Map, int layer,
+                                struct cat_list *cats,
+                                const struct bound_box *boxes, int nboxes)
+{
+    int i, j, n, index, ncats, cat, type, id, area;
+    struct ilist *List;
+    struct boxlist *BoxList;
+    struct bound_box box;
+
+    List = G_new_ilist();
+
+    index = cats ? Vect_cidx_get_field_index(Map, layer) : -1;
+    if (index >= 0) {
+        ncats = Vect_cidx_get_num_cats_by_index(Map, index);
+        for (i = 0; i < ncats; i++) {
+            Vect_cidx_get_cat_by_index(Map, index, i, &cat, &type, &id);
+            if (type != GV_CENTROID || !Vect_cat_in_cat_list(cat, cats))
+                continue;
+            area = Vect_get_centroid_area(Map, id);
+            if (area > 0)
+                G_ilist_add(List, area);
+        }
+    }
+
+    BoxList = Vect_new_boxlist(0);
+    for (i = 0; i < nboxes; i++) {
+        box = boxes[i];
+        box.T = PORT_DOUBLE_MAX;
+        box.B = -PORT_DOUBLE_MAX;
+        Vect_select_areas_by_box(Map, &box, BoxList);
+        for (j = 0; j < BoxList->n_values; j++)
+            G_ilist_add(List, BoxList->id[j]);
+    }
+    Vect_destroy_boxlist(BoxList);
+
+    qsort(List->value, List->n_values, sizeof(int), cmp_int);
+    n = 0;
+    for (i = 0; i < List->n_values; i++) {
+        if (n > 0 && List->value[i] == List->value[n - 1])
+            continue;
+        List->value[n++] = List->value[i];
+    }
+    List->n_values = n;
+
+    G_verbose_message(_("%d changed areas"), n);
+
+    return List;
+}
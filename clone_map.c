@@ -0,0 +1,134 @@
+/***************************************************************
+ *
+ * MODULE:       v.rmarea
+ *
+ * AUTHOR(S):    Markus Metz
+ *
+ * PURPOSE:      Clone a native vector map together with its topology
+ *
+ * COPYRIGHT:    (C) 2024 by the GRASS Development Team
+ *
+ *               This program is free software under the
+ *               GNU General Public License (>=v2).
+ *               Read the file COPYING that comes with GRASS
+ *               for details.
+ *
+ **************************************************************/
+#include <unistd.h>
+
+#include <grass/gis.h>
+#include <grass/vector.h>
+#include <grass/glocale.h>
+
+#include "proto.h"
+
+#define NELEMENTS 4
+
+/* files making up a native vector map with topology */
+static const char *elements[NELEMENTS] = {GV_COOR_ELEMENT, GV_TOPO_ELEMENT,
+                                          GV_SIDX_ELEMENT, GV_CIDX_ELEMENT};
+
+/* delete all features but boundaries without category in field,
+ * same as done by Vect_copy_map_lines_field() */
+static void delete_other_layers(struct Map_info *Map, int field)
+{
+    int i, index, ncats, cat, type, id, line, nlines, ndeleted;
+    char *keep;
+
+    nlines = Vect_get_num_lines(Map);
+    keep = G_calloc(nlines + 1, sizeof(char));
+
+    index = Vect_cidx_get_field_index(Map, field);
+    if (index >= 0) {
+        ncats = Vect_cidx_get_num_cats_by_index(Map, index);
+        for (i = 0; i < ncats; i++) {
+            Vect_cidx_get_cat_by_index(Map, index, i, &cat, &type, &id);
+            if (type != GV_AREA && id > 0 && id <= nlines)
+                keep[id] = 1;
+        }
+    }
+
+    ndeleted = 0;
+    for (line = 1; line <= nlines; line++) {
+        if (keep[line] || !Vect_line_alive(Map, line))
+            continue;
+        if (Vect_get_line_type(Map, line) == GV_BOUNDARY)
+            continue;
+
+        Vect_delete_line(Map, line);
+        ndeleted++;
+    }
+    G_free(keep);
+
+    if (ndeleted > 0)
+        G_verbose_message(_("%d features without category in layer %d "
+                            "skipped"),
+                          ndeleted, field);
+}
+
+/*!
+   \brief Copy a native vector map including its topology
+
+   Instead of writing all features one by one and building topology
+   again, the coor, topo, sidx and cidx files of the input are copied
+   and the output is reopened for update on level 2.
+
+   Out must have been created with Vect_open_new() and must still be
+   empty. It is closed and reopened, header and history written so far
+   are kept.
+
+   \param In input vector map
+   \param Out output vector map
+   \param field layer number, -1 for all layers
+
+   \return 1 on success
+   \return 0 if the input can not be cloned, Out is not changed
+ */
+int clone_native_map(struct Map_info *In, struct Map_info *Out, int field)
+{
+    char in_path[GPATH_MAX], out_path[NELEMENTS][GPATH_MAX];
+    char *name;
+    int i;
+
+    if (Vect_maptype(In) != GV_FORMAT_NATIVE ||
+        Vect_maptype(Out) != GV_FORMAT_NATIVE)
+        return 0;
+    /* temporary maps are deleted when closed */
+    if (Out->temporary)
+        return 0;
+    if (Vect_level(In) < 2 || Vect_get_built(In) < GV_BUILD_ALL)
+        return 0;
+    for (i = 0; i < NELEMENTS; i++) {
+        Vect__get_element_path(in_path, In, elements[i]);
+        if (access(in_path, R_OK) != 0)
+            return 0;
+        Vect__get_element_path(out_path[i], Out, elements[i]);
+    }
+
+    G_important_message(_("Copying input vector map with topology..."));
+
+    name = G_store(Vect_get_name(Out));
+    /* writes header and history, there is no topology yet */
+    Vect_close(Out);
+
+    for (i = 0; i < NELEMENTS; i++) {
+        Vect__get_element_path(in_path, In, elements[i]);
+        if (!G_copy_file(in_path, out_path[i])) {
+            Vect_delete(name);
+            G_fatal_error(_("Unable to copy <%s> to <%s>"), in_path,
+                          out_path[i]);
+        }
+    }
+
+    Vect_set_open_level(2);
+    if (Vect_open_update(Out, name, G_mapset()) < 0)
+        G_fatal_error(_("Unable to open vector map <%s>"), name);
+    G_free(name);
+
+    if (field > 0) {
+        Vect_set_category_index_update(Out);
+        delete_other_layers(Out, field);
+    }
+
+    return 1;
+}
@@ -1,62 +1,216 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
 #include <grass/gis.h>
 #include <grass/vector.h>
 #include <grass/dbmi.h>
 #include <grass/glocale.h>
 
-void copy_tabs(struct Map_info *In, struct Map_info *Out)
+#include "proto.h"
+
+static int cmp_int(const void *a, const void *b)
+{
+    int ia = *(const int *)a;
+    int ib = *(const int *)b;
+
+    return (ia > ib) - (ia < ib);
+}
+
+/*!
+   \brief Get the database links of the input
+
+   The links are kept after the input is closed, database names are
+   already substituted.
+ */
+struct dblinks *get_dblinks(struct Map_info *In)
+{
+    int i;
+    struct field_info *Fi;
+    struct dblinks *Links;
+
+    Links = Vect_new_dblinks_struct();
+    for (i = 0; i < Vect_get_num_dblinks(In); i++) {
+        Fi = Vect_get_dblink(In, i);
+        Vect_add_dblink(Links, Fi->number, Fi->name, Fi->table, Fi->key,
+                        Fi->database, Fi->driver);
+        Vect_destroy_field_info(Fi);
+    }
+
+    return Links;
+}
+
+/* unique categories of a layer of the category index */
+static int get_field_cats(struct Map_info *Map, int index, int *cats)
+{
+    int i, ncats, n, cat, type, id;
+
+    ncats = Vect_cidx_get_num_cats_by_index(Map, index);
+    n = 0;
+    for (i = 0; i < ncats; i++) {
+        Vect_cidx_get_cat_by_index(Map, index, i, &cat, &type, &id);
+        cats[n++] = cat;
+    }
+    /* the index is sorted by category unless modified after building */
+    if (!Map->plus.cidx_up_to_date)
+        qsort(cats, n, sizeof(int), cmp_int);
+
+    ncats = n;
+    n = 0;
+    for (i = 0; i < ncats; i++) {
+        if (n > 0 && cats[i] == cats[n - 1])
+            continue;
+        cats[n++] = cats[i];
+    }
+
+    return n;
+}
+
+/* categories inserted per statement into the temporary table */
+#define CATS_PER_INSERT 1000
+
+static int execute(dbDriver *driver, const char *sql)
 {
-    int nlines, line, i;
+    dbString stmt;
+    int ret;
+
+    G_debug(3, "SQL: %s", sql);
+
+    db_init_string(&stmt);
+    db_set_string(&stmt, sql);
+    ret = db_execute_immediate(driver, &stmt);
+    db_free_string(&stmt);
+
+    return ret;
+}
+
+/*!
+   \brief Copy selected rows of a table within one SQLite database
+
+   The categories are written to a temporary table and all rows are
+   copied with a single INSERT ... SELECT inside one transaction,
+   instead of copying row by row.
+
+   \return DB_OK on success
+   \return DB_FAILED on failure, nothing is created
+ */
+static int copy_table_sqlite(const struct field_info *IFi,
+                             const char *to_table, const char *database,
+                             const int *cats, int ncats)
+{
+    int i, ret;
+    char buf[32];
+    dbDriver *driver;
+    dbString sql, table_name;
+    dbTable *table;
+
+    driver = db_start_driver_open_database(IFi->driver, database);
+    if (!driver)
+        return DB_FAILED;
+
+    db_init_string(&table_name);
+    db_set_string(&table_name, IFi->table);
+    if (db_describe_table(driver, &table_name, &table) != DB_OK) {
+        db_free_string(&table_name);
+        db_close_database_shutdown_driver(driver);
+        return DB_FAILED;
+    }
+    db_free_string(&table_name);
+
+    db_begin_transaction(driver);
+
+    ret = execute(driver, "CREATE TEMPORARY TABLE rmarea_cats "
+                          "(cat integer PRIMARY KEY)");
+
+    db_init_string(&sql);
+    for (i = 0; ret == DB_OK && i < ncats; i++) {
+        if (i % CATS_PER_INSERT == 0)
+            db_set_string(&sql, "INSERT INTO rmarea_cats VALUES ");
+        else
+            db_append_string(&sql, ",");
+        sprintf(buf, "(%d)", cats[i]);
+        db_append_string(&sql, buf);
+
+        if (i % CATS_PER_INSERT == CATS_PER_INSERT - 1 || i == ncats - 1) {
+            G_debug(3, "SQL: insert %d categories", i % CATS_PER_INSERT + 1);
+            ret = db_execute_immediate(driver, &sql);
+        }
+    }
+
+    if (ret == DB_OK) {
+        db_set_table_name(table, to_table);
+        ret = db_create_table(driver, table);
+    }
+    if (ret == DB_OK) {
+        db_set_string(&sql, "INSERT INTO ");
+        db_append_string(&sql, to_table);
+        db_append_string(&sql, " SELECT * FROM ");
+        db_append_string(&sql, IFi->table);
+        db_append_string(&sql, " WHERE ");
+        db_append_string(&sql, IFi->key);
+        db_append_string(&sql, " IN (SELECT cat FROM rmarea_cats)");
+        ret = execute(driver, db_get_string(&sql));
+    }
+    db_free_string(&sql);
+    db_free_table(table);
+
+    if (ret == DB_OK) {
+        /* the temporary table is dropped with the connection anyway,
+         * the output table must not be rolled back for it */
+        if (execute(driver, "DROP TABLE rmarea_cats") != DB_OK)
+            G_warning(_("Unable to drop temporary table <%s>"),
+                      "rmarea_cats");
+        ret = db_commit_transaction(driver);
+    }
+    else {
+        execute(driver, "ROLLBACK");
+    }
+    db_close_database_shutdown_driver(driver);
+
+    return ret;
+}
+
+/*!
+   \brief Copy the attributes of the output categories
+
+   \param Links database links of the input
+   \param Map map with the output features and their category index,
+   Out or a temporary copy of it
+   \param Out output vector map
+ */
+void copy_tabs(const struct dblinks *Links, struct Map_info *Map,
+               struct Map_info *Out)
+{
+    int i, j;
     int ttype, ntabs;
     int **ocats, *nocats, nfields, *fields;
 
-    struct field_info *IFi, *OFi;
-    struct line_cats *Cats;
+    const struct field_info *IFi;
+    struct field_info *OFi;
     dbDriver *driver;
 
     ntabs = 0;
 
-    /* Collect list of output cats */
-    Cats = Vect_new_cats_struct();
-    nfields = Vect_cidx_get_num_fields(Out);
+    /* Collect list of output cats from the category index */
+    nfields = Vect_cidx_get_num_fields(Map);
     ocats = (int **)G_malloc(nfields * sizeof(int *));
     nocats = (int *)G_malloc(nfields * sizeof(int));
     fields = (int *)G_malloc(nfields * sizeof(int));
     for (i = 0; i < nfields; i++) {
-        nocats[i] = 0;
-        ocats[i] = (int *)G_malloc(Vect_cidx_get_num_cats_by_index(Out, i) *
+        ocats[i] = (int *)G_malloc(Vect_cidx_get_num_cats_by_index(Map, i) *
                                    sizeof(int));
-        fields[i] = Vect_cidx_get_field_number(Out, i);
-    }
-
-    nlines = Vect_get_num_lines(Out);
-    for (line = 1; line <= nlines; line++) {
-        Vect_read_line(Out, NULL, Cats, line);
-
-        for (i = 0; i < Cats->n_cats; i++) {
-            int f, j;
-
-            f = -1;
-            for (j = 0; j < nfields; j++) { /* find field */
-                if (fields[j] == Cats->field[i]) {
-                    f = j;
-                    break;
-                }
-            }
-            if (f >= 0) {
-                ocats[f][nocats[f]] = Cats->cat[i];
-                nocats[f]++;
-            }
-        }
+        nocats[i] = get_field_cats(Map, i, ocats[i]);
+        fields[i] = Vect_cidx_get_field_number(Map, i);
     }
 
     /* Copy tables */
     G_message(_("Writing attributes..."));
 
     /* Number of output tabs */
-    for (i = 0; i < Vect_get_num_dblinks(In); i++) {
-        int j, f = -1;
+    for (i = 0; i < Links->n_fields; i++) {
+        int f = -1;
 
-        IFi = Vect_get_dblink(In, i);
+        IFi = &Links->field[i];
 
         for (j = 0; j < nfields; j++) { /* find field */
             if (fields[j] == IFi->number) {
@@ -83,8 +237,14 @@ void copy_tabs(struct Map_info *In, struct Map_info *Out)
 
         G_verbose_message(_("Writing attributes for layer %d"), fields[i]);
 
-        /* Make a list of categories */
-        IFi = Vect_get_field(In, fields[i]);
+        /* Find the table of the input */
+        IFi = NULL;
+        for (j = 0; j < Links->n_fields; j++) {
+            if (Links->field[j].number == fields[i]) {
+                IFi = &Links->field[j];
+                break;
+            }
+        }
         if (!IFi) { /* no table */
             G_message(_("No attribute table for layer %d"), fields[i]);
             continue;
@@ -92,10 +252,23 @@ void copy_tabs(struct Map_info *In, struct Map_info *Out)
 
         OFi = Vect_default_field_info(Out, IFi->number, NULL, ttype);
 
-        ret = db_copy_table_by_ints(IFi->driver, IFi->database, IFi->table,
-                                    OFi->driver,
-                                    Vect_subst_var(OFi->database, Out),
-                                    OFi->table, IFi->key, ocats[i], nocats[i]);
+        ret = DB_FAILED;
+        /* same SQLite database: copy rows with a single statement */
+        if (strcmp(IFi->driver, "sqlite") == 0 &&
+            strcmp(OFi->driver, "sqlite") == 0 &&
+            strcmp(IFi->database, Vect_subst_var(OFi->database, Out)) == 0) {
+            ret = copy_table_sqlite(IFi, OFi->table, IFi->database, ocats[i],
+                                    nocats[i]);
+            if (ret != DB_OK)
+                G_debug(1, "Unable to copy table <%s> with SQL, "
+                           "copying row by row",
+                        IFi->table);
+        }
+        if (ret != DB_OK)
+            ret = db_copy_table_by_ints(
+                IFi->driver, IFi->database, IFi->table, OFi->driver,
+                Vect_subst_var(OFi->database, Out), OFi->table, IFi->key,
+                ocats[i], nocats[i]);
 
         if (ret == DB_FAILED) {
             G_warning(_("Unable to copy table <%s>"), IFi->table);
@@ -129,4 +302,10 @@ void copy_tabs(struct Map_info *In, struct Map_info *Out)
                                 IFi->key, OFi->database, OFi->driver);
         }
     }
+
+    for (i = 0; i < nfields; i++)
+        G_free(ocats[i]);
+    G_free(ocats);
+    G_free(nocats);
+    G_free(fields);
 }
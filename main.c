@@ -26,32 +26,42 @@
 #include "proto.h"
 
 static void error_handler_err(void *p);
+static char *read_history(struct Map_info *Map);
 
 int main(int argc, char *argv[])
 {
-    struct Map_info In, Out, Err, *pErr;
-    int with_z, native;
+    struct Map_info In, Out, Tmp, Err, *pErr, *Map;
+    int with_z, native, field, cloned;
     struct GModule *module;
     struct {
-        struct Option *in, *field, *out, *thresh, *err, *cols, *where, *cats;
+        struct Option *in, *field, *out, *thresh, *err, *cols, *where, *cats,
+            *order, *nprocs, *report, *assignments, *save_plan,
+            *load_plan, *changed_cats, *changed_bbox, *thresh_col, *rules,
+            *relaxed;
     } opt;
     struct {
-        struct Flag *no_build, *at_boundary;
+        struct Flag *no_build, *at_boundary, *db_classes, *candidates,
+            *dry_run, *fallback;
     } flag;
-    double thresh;
-    int count, count_total;
+    double thresh, *levels;
+    int count, count_total, nremoved, level, nlevels;
     double size;
-    int layer;
-    int ncols, ncols_table, col, nrec, i, j;
+    int layer, order;
+    int ncols;
     struct field_info *Fi = NULL;
-    dbDriver *driver = NULL;
-    dbString table_name;
-    dbTable *table;
-    dbCatValArray *cvarr;
-    char *catcol;
-    char **columns;
-    const char *colname;
+    struct attr_classes classes, relaxed;
+    struct rmarea_params par;
+    struct rmarea_stats stats;
+    int nprocs;
+    struct ilist *Nodes;
+    struct dblinks *Links;
+    char **columns, **relaxed_columns, *history;
+    int nrelaxed;
     struct cat_list *cat_list = NULL;
+    struct merge_log log;
+    struct ilist *seeds = NULL;
+    double *sizes = NULL;
+    struct cat_thresholds cat_thresh;
 
     G_gisinit(argv[0]);
 
@@ -75,10 +85,22 @@ int main(int argc, char *argv[])
     opt.where->guisection = _("Selection");
 
     opt.cols = G_define_standard_option(G_OPT_DB_COLUMNS);
-    opt.cols->required = YES;
+    opt.cols->required = NO;
     opt.cols->guisection = _("Selection");
 
+    opt.relaxed = G_define_standard_option(G_OPT_DB_COLUMNS);
+    opt.relaxed->key = "relaxed_columns";
+    opt.relaxed->label =
+        _("Columns compared when merging with a different neighbor");
+    opt.relaxed->description =
+        _("Subset of columns, with -f only neighbors with identical values "
+          "in these columns");
+    opt.relaxed->guisection = _("Selection");
+
     opt.out = G_define_standard_option(G_OPT_V_OUTPUT);
+    opt.out->required = NO;
+    opt.out->multiple = YES;
+    opt.out->description = _("One output map for each threshold");
 
     opt.err = G_define_standard_option(G_OPT_V_OUTPUT);
     opt.err->key = "error";
@@ -89,8 +111,90 @@ int main(int argc, char *argv[])
     opt.thresh->key = "threshold";
     opt.thresh->type = TYPE_DOUBLE;
     opt.thresh->required = YES;
-    opt.thresh->multiple = NO;
+    opt.thresh->multiple = YES;
     opt.thresh->label = _("Minimum area size in square meters");
+    opt.thresh->description =
+        _("Several thresholds in increasing order, one per output map");
+
+    opt.thresh_col = G_define_standard_option(G_OPT_DB_COLUMN);
+    opt.thresh_col->key = "threshold_column";
+    opt.thresh_col->label =
+        _("Name of attribute column with the threshold of each area");
+    opt.thresh_col->description =
+        _("Areas without value use threshold");
+
+    opt.rules = G_define_standard_option(G_OPT_F_INPUT);
+    opt.rules->key = "rules";
+    opt.rules->required = NO;
+    opt.rules->label = _("Name of file with thresholds of attribute values");
+    opt.rules->description =
+        _("One 'value = threshold' per line, values of the first column");
+
+    opt.order = G_define_option();
+    opt.order->key = "order";
+    opt.order->type = TYPE_STRING;
+    opt.order->required = NO;
+    opt.order->multiple = NO;
+    opt.order->options = "id,size";
+    opt.order->answer = "id";
+    opt.order->label = _("Order in which small areas are removed");
+    opt.order->descriptions = _("id;by area id;"
+                                "size;smallest area first, reproducible "
+                                "independent of digitizing order");
+
+    opt.nprocs = G_define_standard_option(G_OPT_M_NPROCS);
+
+    opt.report = G_define_standard_option(G_OPT_F_OUTPUT);
+    opt.report->key = "report";
+    opt.report->required = NO;
+    opt.report->label = _("Name of output file for a report in JSON format");
+    opt.report->description =
+        _("Counters, time of each phase and peak memory, '-' for stdout");
+
+    opt.assignments = G_define_standard_option(G_OPT_F_OUTPUT);
+    opt.assignments->key = "assignments";
+    opt.assignments->required = NO;
+    opt.assignments->label =
+        _("Name of output file for the merges in CSV format");
+    opt.assignments->description =
+        _("Written with -d, one line per removed area, '-' for stdout");
+
+    opt.save_plan = G_define_standard_option(G_OPT_F_OUTPUT);
+    opt.save_plan->key = "save_plan";
+    opt.save_plan->required = NO;
+    opt.save_plan->label = _("Name of output file for the applied merges");
+    opt.save_plan->description =
+        _("Binary file to be applied to the same input with load_plan");
+    opt.save_plan->guisection = _("Plan");
+
+    opt.load_plan = G_define_standard_option(G_OPT_F_INPUT);
+    opt.load_plan->key = "load_plan";
+    opt.load_plan->required = NO;
+    opt.load_plan->label = _("Name of input file with merges to apply");
+    opt.load_plan->description =
+        _("Written by save_plan, attributes are not compared");
+    opt.load_plan->guisection = _("Plan");
+
+    opt.changed_cats = G_define_standard_option(G_OPT_V_CATS);
+    opt.changed_cats->key = "changed_cats";
+    opt.changed_cats->label =
+        _("Categories of areas changed since small areas were removed");
+    opt.changed_cats->description =
+        _("Only these areas and areas changed by merges are checked");
+    opt.changed_cats->guisection = _("Incremental");
+
+    opt.changed_bbox = G_define_option();
+    opt.changed_bbox->key = "changed_bbox";
+    opt.changed_bbox->type = TYPE_DOUBLE;
+    opt.changed_bbox->required = NO;
+    opt.changed_bbox->multiple = YES;
+    opt.changed_bbox->key_desc = "n,s,e,w";
+    opt.changed_bbox->label =
+        _("Extents changed since small areas were removed");
+    opt.changed_bbox->description =
+        _("Only areas overlapping these extents and areas changed by merges "
+          "are checked");
+    opt.changed_bbox->guisection = _("Incremental");
 
     flag.no_build = G_define_flag();
     flag.no_build->key = 'b';
@@ -104,10 +208,60 @@ int main(int argc, char *argv[])
     flag.at_boundary->description =
         _("At least one neighboring area must have selected attributes different from the current area");
 
+    flag.db_classes = G_define_flag();
+    flag.db_classes->key = 's';
+    flag.db_classes->label =
+        _("Compare attributes in the database with a single query");
+    flag.db_classes->description =
+        _("Requires support for window functions, e.g. SQLite >= 3.25");
+    flag.db_classes->guisection = _("Selection");
+
+    flag.candidates = G_define_flag();
+    flag.candidates->key = 'c';
+    flag.candidates->label =
+        _("Load attributes only of small areas and their neighbors");
+    flag.candidates->description =
+        _("Faster for large attribute tables if few areas are small");
+    flag.candidates->guisection = _("Selection");
+
+    flag.dry_run = G_define_flag();
+    flag.dry_run->key = 'd';
+    flag.dry_run->label =
+        _("Only compute which areas would be merged with which area");
+    flag.dry_run->description =
+        _("Topology of the input is required, no vector map is created");
+
+    flag.fallback = G_define_flag();
+    flag.fallback->key = 'f';
+    flag.fallback->label =
+        _("Merge areas without neighbor with identical attributes with "
+          "another neighbor");
+    flag.fallback->description =
+        _("Done after all areas with identical neighbors were merged");
+    flag.fallback->guisection = _("Selection");
+
+    G_option_required(opt.out, flag.dry_run, NULL);
+    G_option_excludes(flag.dry_run, opt.out, opt.err, NULL);
+    G_option_requires(flag.dry_run, opt.assignments, NULL);
+    G_option_required(opt.cols, opt.load_plan, NULL);
+    G_option_exclusive(flag.dry_run, opt.save_plan, opt.load_plan, NULL);
+    G_option_excludes(flag.dry_run, opt.changed_cats, opt.changed_bbox, NULL);
+    G_option_excludes(opt.load_plan, opt.changed_cats, opt.changed_bbox,
+                      NULL);
+    G_option_exclusive(opt.thresh_col, opt.rules, NULL);
+    G_option_requires(opt.relaxed, flag.fallback, NULL);
+    G_option_excludes(opt.load_plan, opt.thresh_col, opt.rules, NULL);
+    G_option_excludes(opt.load_plan, flag.fallback, opt.relaxed, NULL);
+
     if (G_parser(argc, argv))
         exit(EXIT_FAILURE);
 
-    Vect_check_input_output_name(opt.in->answer, opt.out->answer, G_FATAL_EXIT);
+    phase_start(PHASE_TOTAL);
+
+    for (level = 0; opt.out->answer && opt.out->answers[level]; level++) {
+        Vect_check_input_output_name(opt.in->answer, opt.out->answers[level],
+                                     G_FATAL_EXIT);
+    }
     if (opt.err->answer) {
         Vect_check_input_output_name(opt.in->answer, opt.err->answer,
                                      G_FATAL_EXIT);
@@ -136,16 +290,169 @@ int main(int argc, char *argv[])
         cat_list = Vect_cats_set_constraint(&In, layer, opt.where->answer,
                                             opt.cats->answer);
 
-    /* Read threshold */
-    thresh = atof(opt.thresh->answer);
-    G_message(_("Tool: Threshold"));
+    nprocs = G_set_omp_num_threads(opt.nprocs);
 
-    G_message("%s: %.15g", _("Remove small areas"), thresh);
+    order = ORDER_ID;
+    if (strcmp(opt.order->answer, "size") == 0)
+        order = ORDER_SIZE;
+
+    /* Read thresholds */
+    nlevels = 0;
+    while (opt.thresh->answers[nlevels])
+        nlevels++;
+    levels = G_malloc(nlevels * sizeof(double));
+    G_message(_("Tool: Threshold"));
+    for (level = 0; level < nlevels; level++) {
+        levels[level] = atof(opt.thresh->answers[level]);
+        if (level > 0 && levels[level] <= levels[level - 1])
+            G_fatal_error(_("Thresholds must be given in increasing order"));
+        G_message("%s: %.15g", _("Remove small areas"), levels[level]);
+    }
+    /* the largest threshold decides which areas may be removed at all */
+    thresh = levels[nlevels - 1];
+
+    if (nlevels > 1 && (opt.thresh_col->answer || opt.rules->answer))
+        G_fatal_error(_("Only one threshold allowed with %s or %s"),
+                      opt.thresh_col->key, opt.rules->key);
+
+    if (nlevels > 1) {
+        for (level = 0; opt.out->answer && opt.out->answers[level]; level++)
+            ;
+        if (level != nlevels && !flag.dry_run->answer)
+            G_fatal_error(_("Number of output maps (%d) must be equal to "
+                            "the number of thresholds (%d)"),
+                          level, nlevels);
+        if (flag.dry_run->answer || opt.save_plan->answer ||
+            opt.load_plan->answer || opt.changed_cats->answer ||
+            opt.changed_bbox->answer)
+            G_fatal_error(_("Several thresholds are not supported with -%c, "
+                            "%s, %s, %s or %s"),
+                          flag.dry_run->key, opt.save_plan->key,
+                          opt.load_plan->key, opt.changed_cats->key,
+                          opt.changed_bbox->key);
+    }
+    else if (opt.out->answer && opt.out->answers[1]) {
+        G_fatal_error(_("Only one output map allowed with one threshold"));
+    }
 
     G_message(SEP);
 
-    if (Vect_open_new(&Out, opt.out->answer, with_z) < 0)
-        G_fatal_error(_("Unable to create vector map <%s>"), opt.out->answer);
+    /* columns */
+    ncols = 0;
+    columns = opt.cols->answers;
+    while (columns && columns[ncols]) {
+        ncols++;
+    }
+
+    G_debug(1, "Number of columns to check: %d", ncols);
+
+    /* relaxed columns must be a subset of columns */
+    nrelaxed = 0;
+    relaxed_columns = opt.relaxed->answers;
+    while (relaxed_columns && relaxed_columns[nrelaxed]) {
+        int i;
+
+        for (i = 0; i < ncols; i++) {
+            if (strcmp(relaxed_columns[nrelaxed], columns[i]) == 0)
+                break;
+        }
+        if (i == ncols)
+            G_fatal_error(_("Column <%s> of <%s> is not in <%s>"),
+                          relaxed_columns[nrelaxed], opt.relaxed->key,
+                          opt.cols->key);
+        nrelaxed++;
+    }
+
+    /* a loaded plan is applied without comparing attributes */
+    merge_log_init(&log);
+    if (opt.load_plan->answer) {
+        merge_log_read(&log, opt.load_plan->answer);
+        memset(&classes, 0, sizeof(struct attr_classes));
+        memset(&relaxed, 0, sizeof(struct attr_classes));
+    }
+    else {
+        Fi = Vect_get_field(&In, layer);
+        if (Fi == NULL)
+            G_fatal_error(_("Database connection not defined for layer %d"),
+                          layer);
+    }
+
+    /* thresholds of categories, the largest one limits the candidates */
+    if (opt.thresh_col->answer || opt.rules->answer) {
+        phase_start(PHASE_ATTRIBUTES);
+        cat_thresholds_load(&cat_thresh, Fi, opt.thresh_col->answer,
+                            opt.rules->answer, columns[0], thresh);
+        phase_stop(PHASE_ATTRIBUTES);
+        thresh = cat_thresh.max;
+    }
+
+    par.thresh = levels[0];
+    par.cat_thresh = NULL;
+    if (opt.thresh_col->answer || opt.rules->answer)
+        par.cat_thresh = &cat_thresh;
+    par.layer = layer;
+    par.classes = &classes;
+    par.cat_list = cat_list;
+    par.at_boundary = flag.at_boundary->answer;
+    par.fallback = flag.fallback->answer;
+    par.relaxed = nrelaxed > 0 ? &relaxed : NULL;
+    par.order = order;
+    par.nprocs = nprocs;
+    memset(&stats, 0, sizeof(struct rmarea_stats));
+    par.stats = &stats;
+    par.record = opt.save_plan->answer ? &log : NULL;
+    par.replay = opt.load_plan->answer ? &log : NULL;
+    par.seeds = NULL;
+    par.sizes = NULL;
+
+    if (flag.dry_run->answer) {
+        struct merge_plan plan;
+        struct ilist *cats = NULL;
+
+        /* merges are computed on the topology of the input */
+        if (Vect_level(&In) < 2)
+            G_fatal_error(_("Vector map <%s> has no topology, "
+                            "run v.build first"),
+                          opt.in->answer);
+
+        phase_start(PHASE_ATTRIBUTES);
+        if (flag.candidates->answer)
+            cats = get_candidate_cats(&In, layer, thresh, &sizes);
+        attr_classes_load(&classes, Fi, columns, ncols,
+                          flag.db_classes->answer, cats, &stats);
+        if (par.relaxed)
+            attr_classes_load(&relaxed, Fi, relaxed_columns, nrelaxed,
+                              flag.db_classes->answer, cats, &stats);
+        if (cats)
+            G_free_ilist(cats);
+        phase_stop(PHASE_ATTRIBUTES);
+        G_message(SEP);
+
+        G_message(_("Tool: Plan removal of small areas"));
+        phase_start(PHASE_REMOVE);
+        par.sizes = sizes;
+        count_total = plan_merges(&In, &par, &plan);
+        phase_stop(PHASE_REMOVE);
+        G_free(sizes);
+
+        plan_write_csv(&plan, opt.assignments->answer);
+        plan_free(&plan);
+        attr_classes_free(&classes);
+        if (par.relaxed)
+            attr_classes_free(&relaxed);
+        Vect_close(&In);
+
+        phase_stop(PHASE_TOTAL);
+        phase_report();
+        if (opt.report->answer)
+            write_report(opt.report->answer, &stats, count_total, par.thresh);
+
+        exit(EXIT_SUCCESS);
+    }
+
+    if (Vect_open_new(&Out, opt.out->answers[0], with_z) < 0)
+        G_fatal_error(_("Unable to create vector map <%s>"),
+                      opt.out->answers[0]);
 
     Vect_set_error_handler_io(&In, &Out);
 
@@ -165,114 +472,230 @@ int main(int argc, char *argv[])
     Vect_copy_head_data(&In, &Out);
     Vect_hist_copy(&In, &Out);
     Vect_hist_command(&Out);
-
-    native = Vect_maptype(&Out) == GV_FORMAT_NATIVE;
-
-    /* columns */
-    ncols = 0;
-    columns = opt.cols->answers;
-    while (columns[ncols]) {
-        ncols++;
-    }
-
-    G_debug(1, "Number of columns to check: %d", ncols);
-
-    Fi = Vect_get_field(&In, layer);
-    if (Fi == NULL)
-        G_fatal_error(_("Database connection not defined for layer %d"), layer);
-    catcol = Fi->key;
-    driver = db_start_driver_open_database(Fi->driver, Fi->database);
-    db_init_string(&table_name);
-    db_set_string(&table_name, Fi->table);
-    if (db_describe_table(driver, &table_name, &table) != DB_OK)
-        G_fatal_error(_("Unable to describe table <%s>"), Fi->table);
-
-    ncols_table = db_get_table_number_of_columns(table);
-    cvarr = G_malloc(sizeof(dbCatValArray) * ncols);
-
-    G_debug(1, "Number of columns in table: %d", ncols_table);
-
-    G_message("Copy attributes for %d columns ...", ncols);
-
-    i = 0;
-    for (col = 0; col < ncols_table; col++) {
-        int use_col = 0;
-
-        colname = db_get_column_name(db_get_table_column(table, col));
-        for (j = 0; j < ncols; j++) {
-            if (strcmp(colname, columns[j]) == 0) {
-                use_col = 1;
-                break;
-            }
+    /* the input is closed before the outputs of higher levels are
+     * created, its history is kept for them */
+    history = nlevels > 1 ? read_history(&In) : NULL;
+
+    /* Areas are removed in a temporary native map if the output is not
+     * native or if there are several outputs, the result is written to
+     * the output in one pass */
+    Map = &Out;
+    if (Vect_maptype(&Out) != GV_FORMAT_NATIVE || nlevels > 1) {
+        if (Vect_open_tmp_new(&Tmp, NULL, with_z) < 0) {
+            if (nlevels > 1)
+                G_fatal_error(_("Unable to create temporary vector map"));
+            G_warning(_("Unable to create temporary vector map, "
+                        "removing areas directly in the output"));
         }
-
-        if (use_col) {
-            db_CatValArray_init(&cvarr[i]);
-            nrec = db_select_CatValArray(driver, Fi->table, catcol, colname,
-                                         NULL, &cvarr[i]);
-            i++;
+        else {
+            Vect_copy_head_data(&In, &Tmp);
+            Map = &Tmp;
         }
     }
-    db_close_database_shutdown_driver(driver);
-    driver = NULL;
+    native = Vect_maptype(Map) == GV_FORMAT_NATIVE;
+    field = Vect_get_field_number(&In, opt.field->answer);
+
+    /* with -c attributes are loaded after topology is available */
+    if (!flag.candidates->answer && !par.replay) {
+        phase_start(PHASE_ATTRIBUTES);
+        attr_classes_load(&classes, Fi, columns, ncols,
+                          flag.db_classes->answer, NULL, &stats);
+        if (par.relaxed)
+            attr_classes_load(&relaxed, Fi, relaxed_columns, nrelaxed,
+                              flag.db_classes->answer, NULL, &stats);
+        phase_stop(PHASE_ATTRIBUTES);
+    }
 
-    /* This works for both level 1 and 2 */
-    Vect_copy_map_lines_field(
-        &In, Vect_get_field_number(&In, opt.field->answer), &Out);
+    phase_start(PHASE_COPY);
+    /* A native input with topology is copied file by file,
+     * otherwise feature by feature. This works for both level 1 and 2.
+     * Merge plans refer to ids of areas and lines, which differ between
+     * both ways, plans are always recorded and replayed on a feature by
+     * feature copy */
+    cloned = native && !par.record && !par.replay &&
+             clone_native_map(&In, Map, field);
+    if (!cloned)
+        Vect_copy_map_lines_field(&In, field, Map);
+
+    /* attribute tables are copied at the end, without the input */
+    Links = get_dblinks(&In);
 
     Vect_set_release_support(&In);
     Vect_close(&In);
 
-    if (Vect_get_built(&Out) >= GV_BUILD_CENTROIDS) {
-        Vect_build_partial(&Out, GV_BUILD_CENTROIDS);
-        G_message(SEP);
-    }
-    else {
+    if (Vect_get_built(Map) < GV_BUILD_CENTROIDS)
         G_important_message(_("Rebuilding parts of topology..."));
-        Vect_build_partial(&Out, GV_BUILD_CENTROIDS);
+    Vect_build_partial(Map, GV_BUILD_CENTROIDS);
+    phase_stop(PHASE_COPY);
+    G_message(SEP);
+
+    if (flag.candidates->answer && !par.replay) {
+        struct ilist *cats;
+
+        phase_start(PHASE_ATTRIBUTES);
+        cats = get_candidate_cats(Map, layer, thresh, &sizes);
+        attr_classes_load(&classes, Fi, columns, ncols,
+                          flag.db_classes->answer, cats, &stats);
+        if (par.relaxed)
+            attr_classes_load(&relaxed, Fi, relaxed_columns, nrelaxed,
+                              flag.db_classes->answer, cats, &stats);
+        G_free_ilist(cats);
+        par.sizes = sizes;
+        phase_stop(PHASE_ATTRIBUTES);
         G_message(SEP);
     }
 
+    /* an incremental run checks only changed areas */
+    if (opt.changed_cats->answer || opt.changed_bbox->answer) {
+        struct cat_list *changed_cats = NULL;
+        struct bound_box *boxes = NULL;
+        int i, nboxes = 0;
+
+        if (!cloned && !par.record && !par.replay)
+            G_warning(_("Input vector map could not be copied with its "
+                        "topology, all features were copied"));
+        if (opt.changed_cats->answer) {
+            changed_cats = Vect_new_cat_list();
+            if (Vect_str_to_cat_list(opt.changed_cats->answer,
+                                     changed_cats) > 0)
+                G_fatal_error(_("Invalid categories <%s>"),
+                              opt.changed_cats->answer);
+        }
+        if (opt.changed_bbox->answer) {
+            while (opt.changed_bbox->answers[4 * nboxes])
+                nboxes++;
+            boxes = G_malloc(nboxes * sizeof(struct bound_box));
+            for (i = 0; i < nboxes; i++) {
+                boxes[i].N = atof(opt.changed_bbox->answers[4 * i]);
+                boxes[i].S = atof(opt.changed_bbox->answers[4 * i + 1]);
+                boxes[i].E = atof(opt.changed_bbox->answers[4 * i + 2]);
+                boxes[i].W = atof(opt.changed_bbox->answers[4 * i + 3]);
+            }
+        }
+        seeds = get_changed_areas(Map, layer, changed_cats, boxes, nboxes);
+        par.seeds = seeds;
+        if (changed_cats)
+            Vect_destroy_cat_list(changed_cats);
+        G_free(boxes);
+    }
+
     G_message(_("Tool: Remove small areas"));
-    /* new function to also consider attributes */
+    if (!native && (par.record || par.replay))
+        G_fatal_error(_("Merge plans require a native vector map"));
+    if (!native && par.fallback)
+        G_warning(_("Flag -%c is ignored for vector maps which are not "
+                    "native"),
+                  flag.fallback->key);
+    /* the category index built with topology is kept up to date */
+    if (native)
+        Vect_set_category_index_update(Map);
+
+    /* each level continues with the result of the previous level */
     count_total = 0;
-    count = 1;
-    while (count > 0) {
-        count = remove_small_areas(&Out, thresh, pErr, &size, layer, cvarr,
-                                   ncols, cat_list, flag.at_boundary->answer);
-        if (count > 0) {
-            count_total += count;
-            
-            Vect_build_partial(&Out, GV_BUILD_NONE);
-            Vect_build_partial(&Out, GV_BUILD_CENTROIDS);
+    for (level = 0; level < nlevels; level++) {
+        par.thresh = levels[level];
+        if (level > 0) {
+            G_message(SEP);
+            if (Vect_open_new(&Out, opt.out->answers[level], with_z) < 0)
+                G_fatal_error(_("Unable to create vector map <%s>"),
+                              opt.out->answers[level]);
+            Vect_copy_head_data(Map, &Out);
+            if (history)
+                Vect_hist_write(&Out, history);
+            Vect_hist_command(&Out);
         }
-    }
+        if (nlevels > 1)
+            G_message(_("Threshold %.15g for vector map <%s>"), par.thresh,
+                      Vect_get_name(&Out));
+
+        /* new function to also consider attributes */
+        Nodes = G_new_ilist();
+        phase_start(PHASE_REMOVE);
+        if (native) {
+            /* the native version re-checks only areas changed by a merge
+             * and needs a single call without intermediate rebuilds */
+            nremoved = remove_small_areas(Map, pErr, &size, &par, Nodes);
+        }
+        else {
+            nremoved = 0;
+            count = 1;
+            while (count > 0) {
+                count = remove_small_areas(Map, pErr, &size, &par, NULL);
+                if (count > 0) {
+                    nremoved += count;
+
+                    Vect_build_partial(Map, GV_BUILD_NONE);
+                    Vect_build_partial(Map, GV_BUILD_CENTROIDS);
+                }
+            }
+        }
+        phase_stop(PHASE_REMOVE);
+        count_total += nremoved;
+        /* the sizes are those of the map before the first level */
+        par.sizes = NULL;
+
+        if (nremoved > 0) {
+            G_message(SEP);
+            G_message(_("Tool: Merge boundaries"));
+            phase_start(PHASE_MERGE_LINES);
+            if (native) {
+                /* only where boundaries were removed */
+                merge_boundaries_at_nodes(Map, Nodes, pErr);
+            }
+            else {
+                Vect_build_partial(Map, GV_BUILD_BASE);
+                Vect_merge_lines(Map, GV_BOUNDARY, NULL, pErr);
+            }
+            phase_stop(PHASE_MERGE_LINES);
+        }
+        G_free_ilist(Nodes);
 
-    if (count_total > 0) {
-        Vect_build_partial(&Out, GV_BUILD_BASE);
         G_message(SEP);
-        G_message(_("Tool: Merge boundaries"));
-        Vect_merge_lines(&Out, GV_BOUNDARY, NULL, pErr);
-    }
 
-    G_message(SEP);
+        if (Map != &Out) {
+            G_important_message(_("Writing output vector map..."));
+            phase_start(PHASE_WRITE);
+            Vect_build_partial(Map, GV_BUILD_ALL);
+            Vect_copy_map_lines_field(Map, field, &Out);
+            phase_stop(PHASE_WRITE);
+        }
 
-    if (!flag.no_build->answer) {
-        G_important_message(_("Rebuilding topology for output vector map..."));
-        Vect_build_partial(&Out, GV_BUILD_NONE);
-        Vect_build(&Out);
-    }
-    else {
-        Vect_build_partial(&Out, GV_BUILD_NONE); /* -> topo not saved */
-    }
+        /* with native output, topology, spatial and category index were
+         * kept up to date while removing areas and merging boundaries */
+        phase_start(PHASE_BUILD);
+        if (!flag.no_build->answer && (Map != &Out || !native)) {
+            G_important_message(
+                _("Rebuilding topology for output vector map..."));
+            Vect_build_partial(&Out, GV_BUILD_NONE);
+            Vect_build(&Out);
+        }
+        phase_stop(PHASE_BUILD);
 
-    if (Vect_open_old2(&In, opt.in->answer, "", opt.field->answer) < 0)
-        G_fatal_error(_("Unable to open vector map <%s>"), opt.in->answer);
+        /* output categories are taken from the category index */
+        phase_start(PHASE_TABLES);
+        copy_tabs(Links, Map, &Out);
+        phase_stop(PHASE_TABLES);
 
-    copy_tabs(&In, &Out);
+        if (flag.no_build->answer)
+            Vect_build_partial(&Out, GV_BUILD_NONE); /* -> topo not saved */
 
-    Vect_close(&In);
-    Vect_close(&Out);
+        /* topology is written when closing */
+        phase_start(PHASE_BUILD);
+        Vect_close(&Out);
+        phase_stop(PHASE_BUILD);
+    }
+    if (seeds)
+        G_free_ilist(seeds);
+    attr_classes_free(&classes);
+    if (par.relaxed)
+        attr_classes_free(&relaxed);
+
+    if (par.record)
+        merge_log_write(&log, opt.save_plan->answer);
+    merge_log_free(&log);
+
+    if (Map != &Out)
+        Vect_close(Map); /* deletes the temporary map */
 
     if (pErr) {
         G_message(SEP);
@@ -281,9 +704,39 @@ int main(int argc, char *argv[])
         Vect_close(pErr);
     }
 
+    G_free(levels);
+    G_free(history);
+    G_free(sizes);
+    if (par.cat_thresh)
+        cat_thresholds_free(&cat_thresh);
+
+    phase_stop(PHASE_TOTAL);
+    phase_report();
+    if (opt.report->answer)
+        write_report(opt.report->answer, &stats, count_total, par.thresh);
+
     exit(EXIT_SUCCESS);
 }
 
+/* history of a map as one string */
+char *read_history(struct Map_info *Map)
+{
+    char buf[GPATH_MAX], *history;
+    size_t len, n;
+
+    history = G_store("");
+    len = 0;
+    Vect_hist_rewind(Map);
+    while (Vect_hist_read(buf, sizeof(buf), Map) != NULL) {
+        n = strlen(buf);
+        history = G_realloc(history, len + n + 1);
+        memcpy(history + len, buf, n + 1);
+        len += n;
+    }
+
+    return history;
+}
+
 void error_handler_err(void *p)
 {
     char *name;
@@ -0,0 +1,126 @@
+/***************************************************************
+ *
+ * MODULE:       v.rmarea
+ *
+ * AUTHOR(S):    Markus Metz
+ *
+ * PURPOSE:      Merge boundaries at nodes left with two boundaries
+ *
+ * COPYRIGHT:    (C) 2024 by the GRASS Development Team
+ *
+ *               This program is free software under the
+ *               GNU General Public License (>=v2).
+ *               Read the file COPYING that comes with GRASS
+ *               for details.
+ *
+ **************************************************************/
+#include <stdlib.h>
+
+#include <grass/gis.h>
+#include <grass/vector.h>
+#include <grass/glocale.h>
+
+#include "proto.h"
+
+static int cmp_int(const void *a, const void *b)
+{
+    int ia = *(const int *)a;
+    int ib = *(const int *)b;
+
+    return (ia > ib) - (ia < ib);
+}
+
+/*!
+   \brief Merge boundaries at the given nodes
+
+   Only nodes where boundaries were deleted can be left with exactly two
+   boundaries, thus it is sufficient to check these nodes instead of the
+   whole map. Chains of such nodes are merged into one boundary with the
+   categories of all merged boundaries.
+   Topology is updated, the topology level is not changed.
+
+   \param Map vector map
+   \param Nodes list of nodes, duplicates are allowed, the list is sorted
+   \param Err vector map where merged boundaries are written or NULL
+
+   \return number of merged boundaries
+ */
+int merge_boundaries_at_nodes(struct Map_info *Map, struct ilist *Nodes,
+                              struct Map_info *Err)
+{
+    int i, j, node, nmerged;
+    int line1, line2;
+    struct line_pnts *Points1, *Points2;
+    struct line_cats *Cats1, *Cats2;
+
+    if (Nodes->n_values == 0)
+        return 0;
+
+    Points1 = Vect_new_line_struct();
+    Points2 = Vect_new_line_struct();
+    Cats1 = Vect_new_cats_struct();
+    Cats2 = Vect_new_cats_struct();
+
+    qsort(Nodes->value, Nodes->n_values, sizeof(int), cmp_int);
+
+    nmerged = 0;
+    for (i = 0; i < Nodes->n_values; i++) {
+        G_percent(i, Nodes->n_values, 2);
+
+        node = Nodes->value[i];
+        if (i > 0 && node == Nodes->value[i - 1])
+            continue;
+
+        if (!Vect_node_alive(Map, node))
+            continue;
+        if (Vect_get_node_n_lines(Map, node) != 2)
+            continue;
+
+        /* > 0: line starts at node, < 0: line ends at node */
+        line1 = Vect_get_node_line(Map, node, 0);
+        line2 = Vect_get_node_line(Map, node, 1);
+        if (abs(line1) == abs(line2))
+            continue; /* closed boundary */
+        if (Vect_get_line_type(Map, abs(line1)) != GV_BOUNDARY ||
+            Vect_get_line_type(Map, abs(line2)) != GV_BOUNDARY)
+            continue;
+
+        G_debug(3, "merge boundaries %d and %d at node %d", line1, line2,
+                node);
+
+        Vect_read_line(Map, Points1, Cats1, abs(line1));
+        Vect_read_line(Map, Points2, Cats2, abs(line2));
+
+        /* first boundary ends at node, second boundary starts at node */
+        if (line1 > 0)
+            Vect_line_reverse(Points1);
+        if (line2 < 0)
+            Vect_line_reverse(Points2);
+        for (j = 1; j < Points2->n_points; j++)
+            Vect_append_point(Points1, Points2->x[j], Points2->y[j],
+                              Points2->z[j]);
+        /* the merged boundary keeps the categories of both boundaries,
+         * the category index is updated by deleting and writing */
+        for (j = 0; j < Cats2->n_cats; j++)
+            Vect_cat_set(Cats1, Cats2->field[j], Cats2->cat[j]);
+
+        Vect_delete_line(Map, abs(line1));
+        Vect_delete_line(Map, abs(line2));
+        Vect_write_line(Map, GV_BOUNDARY, Points1, Cats1);
+
+        if (Err)
+            Vect_write_line(Err, GV_BOUNDARY, Points1, Cats1);
+
+        nmerged++;
+    }
+    G_percent(1, 1, 1);
+
+    G_verbose_message(_("%d boundaries merged"), nmerged);
+
+    Vect_destroy_line_struct(Points1);
+    Vect_destroy_line_struct(Points2);
+    Vect_destroy_cats_struct(Cats1);
+    Vect_destroy_cats_struct(Cats2);
+
+    return nmerged;
+}
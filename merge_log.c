@@ -0,0 +1,391 @@
+/***************************************************************
+ *
+ * MODULE:       v.rmarea
+ *
+ * AUTHOR(S):    Markus Metz
+ *
+ * PURPOSE:      Record the merges of a run in a binary file to be
+ *               replayed by later runs
+ *
+ * COPYRIGHT:    (C) 2024 by the GRASS Development Team
+ *
+ *               This program is free software under the
+ *               GNU General Public License (>=v2).
+ *               Read the file COPYING that comes with GRASS
+ *               for details.
+ *
+ **************************************************************/
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <stdint.h>
+
+#include <grass/gis.h>
+#include <grass/vector.h>
+#include <grass/glocale.h>
+
+#include "proto.h"
+
+/* The file starts with a magic string and a version, followed by the
+ * number of merges and of deleted boundaries, the fingerprint of the map
+ * the merges were applied to, and the arrays of the log. Integers are
+ * written with 4 bytes and doubles with 8 bytes, least significant byte
+ * first, independent of the machine. */
+
+#define LOG_MAGIC   "RMAREA-PLAN"
+#define LOG_VERSION 3
+
+/* FNV-1a of a 64 bit value, least significant byte first */
+static uint32_t hash_value(uint32_t h, uint64_t value)
+{
+    int i;
+
+    for (i = 0; i < 8; i++) {
+        h ^= (uint32_t)(value & 0xff);
+        h *= 16777619u;
+        value >>= 8;
+    }
+
+    return h;
+}
+
+static uint64_t double_bits(double d)
+{
+    uint64_t bits;
+
+    memcpy(&bits, &d, sizeof(bits));
+
+    return bits;
+}
+
+void merge_log_init(struct merge_log *log)
+{
+    memset(log, 0, sizeof(struct merge_log));
+}
+
+void merge_log_free(struct merge_log *log)
+{
+    G_free(log->area);
+    G_free(log->neighbour);
+    G_free(log->first);
+    G_free(log->nlines);
+    G_free(log->lines);
+    merge_log_init(log);
+}
+
+/*!
+   \brief Append a merge
+
+   \param log merge log
+   \param area removed area
+   \param neighbour area (> 0) or isle (< 0) it was merged with
+   \param lines deleted boundaries
+   \param nlines number of deleted boundaries
+ */
+void merge_log_add(struct merge_log *log, int area, int neighbour,
+                   const int *lines, int nlines)
+{
+    if (log->n == log->alloc) {
+        log->alloc = log->n + 1000 + log->alloc / 2;
+        log->area = G_realloc(log->area, log->alloc * sizeof(int));
+        log->neighbour = G_realloc(log->neighbour, log->alloc * sizeof(int));
+        log->first = G_realloc(log->first, log->alloc * sizeof(int));
+        log->nlines = G_realloc(log->nlines, log->alloc * sizeof(int));
+    }
+    if (log->n_lines + nlines > log->alloc_lines) {
+        log->alloc_lines = log->n_lines + nlines + 1000 + log->alloc_lines / 2;
+        log->lines = G_realloc(log->lines, log->alloc_lines * sizeof(int));
+    }
+
+    log->area[log->n] = area;
+    log->neighbour[log->n] = neighbour;
+    log->first[log->n] = log->n_lines;
+    log->nlines[log->n] = nlines;
+    memcpy(log->lines + log->n_lines, lines, nlines * sizeof(int));
+    log->n_lines += nlines;
+    log->n++;
+}
+
+/*!
+   \brief Get the fingerprint of the topology of a map
+
+   Merges can only be replayed on a map with identical topology, e.g. a
+   copy of the same input made the same way. Besides the numbers of
+   primitives, the checksum covers type, nodes and areas of each line and
+   the coordinates of each node in the order of their ids, taken from
+   topology without reading the geometry. Offsets of lines in the coor
+   file are not included, they depend on how the map was written.
+ */
+void merge_log_fingerprint(struct Map_info *Map,
+                           struct topo_fingerprint *fp)
+{
+    struct Plus_head *plus = &Map->plus;
+    uint32_t h;
+    int i, n1, n2, left, right;
+
+    memset(fp, 0, sizeof(struct topo_fingerprint));
+    fp->nodes = Vect_get_num_nodes(Map);
+    fp->lines = Vect_get_num_lines(Map);
+    fp->boundaries = Vect_get_num_primitives(Map, GV_BOUNDARY);
+    fp->centroids = Vect_get_num_primitives(Map, GV_CENTROID);
+    fp->areas = Vect_get_num_areas(Map);
+    fp->isles = Vect_get_num_isles(Map);
+    Vect_get_map_box(Map, &fp->box);
+
+    h = 2166136261u;
+    for (i = 1; i <= fp->lines; i++) {
+        struct P_line *Line = plus->Line[i];
+
+        if (!Line) {
+            h = hash_value(h, 0);
+            continue;
+        }
+        h = hash_value(h, (uint64_t)Line->type);
+        if (Line->type & (GV_LINE | GV_BOUNDARY)) {
+            Vect_get_line_nodes(Map, i, &n1, &n2);
+            h = hash_value(h, (uint64_t)n1);
+            h = hash_value(h, (uint64_t)n2);
+        }
+        if (Line->type == GV_BOUNDARY) {
+            Vect_get_line_areas(Map, i, &left, &right);
+            h = hash_value(h, (uint64_t)(int64_t)left);
+            h = hash_value(h, (uint64_t)(int64_t)right);
+        }
+        else if (Line->type == GV_CENTROID) {
+            h = hash_value(h,
+                           (uint64_t)(int64_t)Vect_get_centroid_area(Map, i));
+        }
+    }
+    for (i = 1; i <= fp->nodes; i++) {
+        struct P_node *Node = plus->Node[i];
+
+        if (!Node) {
+            h = hash_value(h, 0);
+            continue;
+        }
+        h = hash_value(h, double_bits(Node->x));
+        h = hash_value(h, double_bits(Node->y));
+        h = hash_value(h, double_bits(Node->z));
+    }
+    fp->checksum = h;
+}
+
+/*!
+   \brief Check that a map has the topology the merges were recorded on
+
+   \return 1 if the fingerprints match
+   \return 0 otherwise
+ */
+int merge_log_check(const struct merge_log *log, struct Map_info *Map)
+{
+    struct topo_fingerprint fp;
+    const struct topo_fingerprint *lfp = &log->fp;
+
+    merge_log_fingerprint(Map, &fp);
+
+    return fp.nodes == lfp->nodes && fp.lines == lfp->lines &&
+           fp.boundaries == lfp->boundaries &&
+           fp.centroids == lfp->centroids && fp.areas == lfp->areas &&
+           fp.isles == lfp->isles && fp.checksum == lfp->checksum &&
+           fp.box.N == lfp->box.N && fp.box.S == lfp->box.S &&
+           fp.box.E == lfp->box.E && fp.box.W == lfp->box.W &&
+           fp.box.T == lfp->box.T && fp.box.B == lfp->box.B;
+}
+
+/* values are written in chunks of this size */
+#define CHUNK 1024
+
+static void write_ints(FILE *fp, const int *values, int n, const char *file)
+{
+    unsigned char buf[4 * CHUNK];
+    int i, j, k;
+
+    for (i = 0; i < n; i += CHUNK) {
+        for (j = i, k = 0; j < n && j < i + CHUNK; j++, k += 4) {
+            uint32_t v = (uint32_t)values[j];
+
+            buf[k] = v & 0xff;
+            buf[k + 1] = (v >> 8) & 0xff;
+            buf[k + 2] = (v >> 16) & 0xff;
+            buf[k + 3] = (v >> 24) & 0xff;
+        }
+        if (fwrite(buf, 1, k, fp) != (size_t)k)
+            G_fatal_error(_("Unable to write to file <%s>"), file);
+    }
+}
+
+static void read_ints(FILE *fp, int *values, int n, const char *file)
+{
+    unsigned char buf[4 * CHUNK];
+    int i, j, k, nbytes;
+
+    for (i = 0; i < n; i += CHUNK) {
+        nbytes = 4 * (n - i < CHUNK ? n - i : CHUNK);
+        if (fread(buf, 1, nbytes, fp) != (size_t)nbytes)
+            G_fatal_error(_("File <%s> is truncated"), file);
+        for (j = i, k = 0; k < nbytes; j++, k += 4) {
+            uint32_t v = (uint32_t)buf[k] | (uint32_t)buf[k + 1] << 8 |
+                         (uint32_t)buf[k + 2] << 16 |
+                         (uint32_t)buf[k + 3] << 24;
+
+            /* two's complement of negative values */
+            values[j] = v <= INT_MAX ? (int)v : -(int)(~v) - 1;
+        }
+    }
+}
+
+static void write_doubles(FILE *fp, const double *values, int n,
+                          const char *file)
+{
+    unsigned char buf[8];
+    int i, k;
+
+    for (i = 0; i < n; i++) {
+        uint64_t v = double_bits(values[i]);
+
+        for (k = 0; k < 8; k++) {
+            buf[k] = v & 0xff;
+            v >>= 8;
+        }
+        if (fwrite(buf, 1, 8, fp) != 8)
+            G_fatal_error(_("Unable to write to file <%s>"), file);
+    }
+}
+
+static void read_doubles(FILE *fp, double *values, int n, const char *file)
+{
+    unsigned char buf[8];
+    int i, k;
+
+    for (i = 0; i < n; i++) {
+        uint64_t v = 0;
+
+        if (fread(buf, 1, 8, fp) != 8)
+            G_fatal_error(_("File <%s> is truncated"), file);
+        for (k = 7; k >= 0; k--)
+            v = v << 8 | buf[k];
+        memcpy(&values[i], &v, sizeof(double));
+    }
+}
+
+/* fingerprint as integers and doubles */
+static void write_fingerprint(FILE *fp, const struct topo_fingerprint *tfp,
+                              const char *file)
+{
+    int ints[7];
+    double box[6];
+
+    ints[0] = tfp->nodes;
+    ints[1] = tfp->lines;
+    ints[2] = tfp->boundaries;
+    ints[3] = tfp->centroids;
+    ints[4] = tfp->areas;
+    ints[5] = tfp->isles;
+    ints[6] = (int)tfp->checksum;
+    box[0] = tfp->box.N;
+    box[1] = tfp->box.S;
+    box[2] = tfp->box.E;
+    box[3] = tfp->box.W;
+    box[4] = tfp->box.T;
+    box[5] = tfp->box.B;
+    write_ints(fp, ints, 7, file);
+    write_doubles(fp, box, 6, file);
+}
+
+static void read_fingerprint(FILE *fp, struct topo_fingerprint *tfp,
+                             const char *file)
+{
+    int ints[7];
+    double box[6];
+
+    read_ints(fp, ints, 7, file);
+    read_doubles(fp, box, 6, file);
+    memset(tfp, 0, sizeof(struct topo_fingerprint));
+    tfp->nodes = ints[0];
+    tfp->lines = ints[1];
+    tfp->boundaries = ints[2];
+    tfp->centroids = ints[3];
+    tfp->areas = ints[4];
+    tfp->isles = ints[5];
+    tfp->checksum = (unsigned int)ints[6];
+    tfp->box.N = box[0];
+    tfp->box.S = box[1];
+    tfp->box.E = box[2];
+    tfp->box.W = box[3];
+    tfp->box.T = box[4];
+    tfp->box.B = box[5];
+}
+
+void merge_log_write(const struct merge_log *log, const char *file)
+{
+    FILE *fp;
+    int header[3];
+
+    if (!(fp = fopen(file, "wb")))
+        G_fatal_error(_("Unable to open file <%s> for writing"), file);
+
+    header[0] = LOG_VERSION;
+    header[1] = log->n;
+    header[2] = log->n_lines;
+    if (fwrite(LOG_MAGIC, sizeof(LOG_MAGIC), 1, fp) != 1)
+        G_fatal_error(_("Unable to write to file <%s>"), file);
+    write_ints(fp, header, 3, file);
+    write_fingerprint(fp, &log->fp, file);
+
+    write_ints(fp, log->area, log->n, file);
+    write_ints(fp, log->neighbour, log->n, file);
+    write_ints(fp, log->nlines, log->n, file);
+    write_ints(fp, log->lines, log->n_lines, file);
+
+    if (fclose(fp) != 0)
+        G_fatal_error(_("Unable to write to file <%s>"), file);
+
+    G_verbose_message(_("%d merges written to <%s>"), log->n, file);
+}
+
+void merge_log_read(struct merge_log *log, const char *file)
+{
+    FILE *fp;
+    char magic[sizeof(LOG_MAGIC)];
+    int header[3], i;
+
+    if (!(fp = fopen(file, "rb")))
+        G_fatal_error(_("Unable to open file <%s>"), file);
+
+    if (fread(magic, sizeof(magic), 1, fp) != 1 ||
+        memcmp(magic, LOG_MAGIC, sizeof(magic)) != 0)
+        G_fatal_error(_("File <%s> is not a merge plan"), file);
+    read_ints(fp, header, 3, file);
+    if (header[0] != LOG_VERSION)
+        G_fatal_error(_("Unsupported version %d of merge plan <%s>"),
+                      header[0], file);
+    if (header[1] < 0 || header[2] < 0)
+        G_fatal_error(_("File <%s> is not a merge plan"), file);
+
+    merge_log_free(log);
+    read_fingerprint(fp, &log->fp, file);
+
+    log->n = log->alloc = header[1];
+    log->n_lines = log->alloc_lines = header[2];
+    log->area = G_malloc((log->n + 1) * sizeof(int));
+    log->neighbour = G_malloc((log->n + 1) * sizeof(int));
+    log->first = G_malloc((log->n + 1) * sizeof(int));
+    log->nlines = G_malloc((log->n + 1) * sizeof(int));
+    log->lines = G_malloc((log->n_lines + 1) * sizeof(int));
+
+    read_ints(fp, log->area, log->n, file);
+    read_ints(fp, log->neighbour, log->n, file);
+    read_ints(fp, log->nlines, log->n, file);
+    read_ints(fp, log->lines, log->n_lines, file);
+    fclose(fp);
+
+    /* offsets of the boundaries of each merge */
+    for (i = 0; i < log->n; i++) {
+        log->first[i] = i > 0 ? log->first[i - 1] + log->nlines[i - 1] : 0;
+        if (log->nlines[i] < 0 ||
+            log->first[i] + log->nlines[i] > log->n_lines)
+            G_fatal_error(_("File <%s> is not a merge plan"), file);
+    }
+
+    G_verbose_message(_("%d merges read from <%s>"), log->n, file);
+}
@@ -0,0 +1,106 @@
+/***************************************************************
+ *
+ * MODULE:       v.rmarea
+ *
+ * AUTHOR(S):    Markus Metz
+ *
+ * PURPOSE:      Collect the neighbours of an area
+ *
+ * COPYRIGHT:    (C) 2024 by the GRASS Development Team
+ *
+ *               This program is free software under the
+ *               GNU General Public License (>=v2).
+ *               Read the file COPYING that comes with GRASS
+ *               for details.
+ *
+ **************************************************************/
+#include <grass/gis.h>
+#include <grass/vector.h>
+
+#include "proto.h"
+
+/* Neighbours are kept in order of first appearance, an open addressing
+ * hash table maps neighbour ids to their index. Only the slots used by
+ * the current area are cleared for the next area, thus the storage is
+ * reused without clearing the whole table. */
+
+#define SLOT_EMPTY -1
+
+void nbmap_init(struct neighbour_map *nb)
+{
+    nb->slot = NULL;
+    nb->size = 0;
+    nb->neighbour = NULL;
+    nb->length = NULL;
+    nb->pos = NULL;
+    nb->n = nb->alloc = 0;
+}
+
+void nbmap_free(struct neighbour_map *nb)
+{
+    G_free(nb->slot);
+    G_free(nb->neighbour);
+    G_free(nb->length);
+    G_free(nb->pos);
+    nbmap_init(nb);
+}
+
+/*!
+   \brief Remove all neighbours
+
+   \param nb neighbour map
+   \param max maximum number of neighbours to be added next
+ */
+void nbmap_reset(struct neighbour_map *nb, int max)
+{
+    int i;
+
+    if (nb->size < 2 * max) {
+        while (nb->size < 2 * max)
+            nb->size = nb->size ? nb->size << 1 : 64;
+        nb->slot = G_realloc(nb->slot, nb->size * sizeof(int));
+        for (i = 0; i < nb->size; i++)
+            nb->slot[i] = SLOT_EMPTY;
+    }
+    else {
+        for (i = 0; i < nb->n; i++)
+            nb->slot[nb->pos[i]] = SLOT_EMPTY;
+    }
+    if (max > nb->alloc) {
+        nb->alloc = max + 100;
+        nb->neighbour = G_realloc(nb->neighbour, nb->alloc * sizeof(int));
+        nb->length = G_realloc(nb->length, nb->alloc * sizeof(double));
+        nb->pos = G_realloc(nb->pos, nb->alloc * sizeof(int));
+    }
+    nb->n = 0;
+}
+
+/*!
+   \brief Get the index of a neighbour, added if not yet present
+
+   New neighbours start with length 0. At most as many neighbours as
+   given to nbmap_reset() can be added.
+
+   \return index of the neighbour
+ */
+int nbmap_index(struct neighbour_map *nb, int neighbour)
+{
+    unsigned int h;
+    int i;
+
+    h = (unsigned int)neighbour * 2654435761u;
+    h ^= h >> 16;
+    i = h & (nb->size - 1);
+    while (nb->slot[i] != SLOT_EMPTY) {
+        if (nb->neighbour[nb->slot[i]] == neighbour)
+            return nb->slot[i];
+        i = (i + 1) & (nb->size - 1);
+    }
+
+    nb->slot[i] = nb->n;
+    nb->neighbour[nb->n] = neighbour;
+    nb->length[nb->n] = 0;
+    nb->pos[nb->n] = i;
+
+    return nb->n++;
+}
@@ -0,0 +1,425 @@
+/***************************************************************
+ *
+ * MODULE:       v.rmarea
+ *
+ * AUTHOR(S):    Markus Metz
+ *
+ * PURPOSE:      Compute the merges of small areas without changing
+ *               the geometry
+ *
+ * COPYRIGHT:    (C) 2024 by the GRASS Development Team
+ *
+ *               This program is free software under the
+ *               GNU General Public License (>=v2).
+ *               Read the file COPYING that comes with GRASS
+ *               for details.
+ *
+ **************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <grass/gis.h>
+#include <grass/vector.h>
+#include <grass/glocale.h>
+
+#include "proto.h"
+
+/* Merges are simulated on the adjacency graph of the input. Each area
+ * merged with another area becomes part of a region represented by the
+ * area whose centroid is kept, regions are tracked with union-find.
+ * A region keeps the list of its outer neighbours, entries refer to the
+ * original areas and are resolved to their region when the region is
+ * checked. Neighbours across an isle of the area around are stored with
+ * negative id, as in the area graph. The areas inside the isles of a
+ * region are kept in a second list, they are checked again when the
+ * region changes.
+ *
+ * Topology is only read, the plan is the same as the result of the native
+ * version except for areas which become enclosed by merged areas. */
+
+/* neighbours of a region */
+struct plan_list {
+    int *id;
+    double *length;
+    int n, alloc;
+};
+
+struct plan_state {
+    struct Map_info *Map;
+    const struct rmarea_params *par;
+    struct area_metrics metrics;
+    struct worklist wl;
+    int *parent;             /* region of each area */
+    struct plan_list *outer; /* outer neighbours of each region */
+    struct plan_list *inner; /* areas inside isles of each region */
+    struct neighbour_map nbmap;
+    int stage;              /* 2 if merging with any neighbour */
+    struct ilist *Deferred; /* regions without identical neighbour */
+};
+
+static void list_add(struct plan_list *l, int id, double length)
+{
+    if (l->n == l->alloc) {
+        l->alloc = l->alloc ? 2 * l->alloc : 8;
+        l->id = G_realloc(l->id, l->alloc * sizeof(int));
+        l->length = G_realloc(l->length, l->alloc * sizeof(double));
+    }
+    l->id[l->n] = id;
+    l->length[l->n] = length;
+    l->n++;
+}
+
+static void list_free(struct plan_list *l)
+{
+    G_free(l->id);
+    G_free(l->length);
+    l->id = NULL;
+    l->length = NULL;
+    l->n = l->alloc = 0;
+}
+
+/* region of an area, with path halving */
+static int find_region(int *parent, int area)
+{
+    while (parent[area] != area) {
+        parent[area] = parent[parent[area]];
+        area = parent[area];
+    }
+
+    return area;
+}
+
+static void plan_queue(struct plan_state *s, int area)
+{
+    double key;
+
+    if (area <= 0 || !Vect_get_area_centroid(s->Map, area))
+        return;
+
+    key = 0;
+    if (s->par->order == ORDER_SIZE)
+        key = s->metrics.info[area].size;
+
+    worklist_push(&s->wl, area, key);
+}
+
+/* resolve the outer neighbours of a region to regions and sum up their
+ * shared lengths, the list is replaced by the result */
+static void plan_resolve(struct plan_state *s, int region)
+{
+    struct plan_list *l = &s->outer[region];
+    struct neighbour_map *nb = &s->nbmap;
+    int i, k, r;
+
+    nbmap_reset(nb, l->n);
+    for (i = 0; i < l->n; i++) {
+        r = find_region(s->parent, abs(l->id[i]));
+        if (r == region)
+            continue;
+        k = nbmap_index(nb, l->id[i] > 0 ? r : -r);
+        nb->length[k] += l->length[i];
+    }
+    for (k = 0; k < nb->n; k++) {
+        l->id[k] = nb->neighbour[k];
+        l->length[k] = nb->length[k];
+    }
+    l->n = nb->n;
+}
+
+/* same checks as evaluate_area() of the native version */
+static int plan_evaluate(struct plan_state *s, int region,
+                         struct plan_step *step)
+{
+    const struct rmarea_params *par = s->par;
+    struct rmarea_stats *stats = par->stats;
+    const struct area_info *info;
+    struct plan_list *l;
+    int i, narea, acls, different_neighbors, neighbour;
+    int rcls, fb_neighbour, fallback;
+    double length, fb_length;
+
+    if (s->parent[region] != region ||
+        !Vect_get_area_centroid(s->Map, region))
+        return 0;
+
+    stats->examined++;
+    info = &s->metrics.info[region];
+    if (info->size > area_threshold(par, info->cat)) {
+        stats->skipped_threshold++;
+        return 0;
+    }
+
+    if (par->layer > 0 &&
+        (info->cat < 0 || (par->cat_list &&
+                           !Vect_cat_in_cat_list(info->cat, par->cat_list)))) {
+        stats->skipped_constraint++;
+        return 0;
+    }
+
+    acls = info->cls;
+    rcls = -1;
+    if (s->stage == 2 && par->relaxed)
+        rcls = attr_class_get(par->relaxed, info->cat);
+    plan_resolve(s, region);
+    l = &s->outer[region];
+
+    neighbour = fb_neighbour = 0;
+    length = fb_length = -1.0;
+    different_neighbors = 0;
+    for (i = 0; i < l->n; i++) {
+        narea = abs(l->id[i]);
+        if (!Vect_get_area_centroid(s->Map, narea))
+            continue;
+
+        stats->attr_comparisons++;
+        if (acls >= 0 && s->metrics.info[narea].cls == acls) {
+            if (l->length[i] > length) {
+                length = l->length[i];
+                neighbour = l->id[i];
+            }
+        }
+        else {
+            different_neighbors++;
+            if (s->stage == 2 && l->length[i] > fb_length &&
+                (!par->relaxed ||
+                 (rcls >= 0 && attr_class_get(par->relaxed,
+                                              s->metrics.info[narea].cat) ==
+                                   rcls))) {
+                fb_length = l->length[i];
+                fb_neighbour = l->id[i];
+            }
+        }
+    }
+
+    fallback = 0;
+    if (neighbour == 0 && fb_neighbour != 0) {
+        neighbour = fb_neighbour;
+        length = fb_length;
+        fallback = 1;
+    }
+
+    if (neighbour == 0 || (par->at_boundary && !different_neighbors)) {
+        stats->skipped_neighbour++;
+        if (par->fallback && s->stage == 1)
+            G_ilist_add(s->Deferred, region);
+        return 0;
+    }
+
+    if (neighbour > 0)
+        stats->merged_area++;
+    else
+        stats->merged_isle++;
+    if (fallback)
+        stats->merged_fallback++;
+
+    step->area = region;
+    step->cat = info->cat;
+    step->target = abs(neighbour);
+    step->target_cat = s->metrics.info[step->target].cat;
+    step->isle = neighbour < 0;
+    step->fallback = fallback;
+    step->length = length;
+    step->size = info->size;
+
+    return 1;
+}
+
+/* merge region a with region b as described by step */
+static void plan_commit(struct plan_state *s, const struct plan_step *step)
+{
+    int a = step->area, b = step->target;
+    struct plan_list *la = &s->outer[a], *lb = &s->outer[b];
+    int i;
+
+    s->parent[a] = b;
+    metrics_merge(&s->metrics, b, a, b, step->length);
+    s->par->stats->size_removed += step->size;
+
+    if (!step->isle) {
+        /* the outer neighbours of a are now outer neighbours of b */
+        for (i = 0; i < la->n; i++)
+            list_add(lb, la->id[i], la->length[i]);
+    }
+    else {
+        /* a was inside an isle of b, its neighbours still are */
+        for (i = 0; i < la->n; i++) {
+            if (la->id[i] > 0)
+                list_add(&s->inner[b], la->id[i], 0);
+        }
+    }
+    for (i = 0; i < s->inner[a].n; i++)
+        list_add(&s->inner[b], s->inner[a].id[i], 0);
+    list_free(la);
+    list_free(&s->inner[a]);
+
+    /* check the merged region and its neighbours again */
+    plan_queue(s, b);
+    for (i = 0; i < lb->n; i++)
+        plan_queue(s, find_region(s->parent, abs(lb->id[i])));
+    for (i = 0; i < s->inner[b].n; i++)
+        plan_queue(s, find_region(s->parent, s->inner[b].id[i]));
+}
+
+static void plan_add_step(struct merge_plan *plan,
+                          const struct plan_step *step)
+{
+    if (plan->n == plan->alloc) {
+        plan->alloc = plan->alloc ? 2 * plan->alloc : 1000;
+        plan->steps =
+            G_realloc(plan->steps, plan->alloc * sizeof(struct plan_step));
+    }
+    plan->steps[plan->n++] = *step;
+}
+
+/*!
+   \brief Compute which small areas would be merged with which area
+
+   The map must be on level 2, only topology and the centroids are
+   read. Merges are listed in the order they would be applied, areas are
+   identified by the area id in the map. An area may appear as target
+   before it is merged itself, its region then includes the areas merged
+   with it before.
+
+   \param Map vector map with topology
+   \param par settings, the counters are updated
+   \param[out] plan merges
+
+   \return number of merges
+ */
+int plan_merges(struct Map_info *Map, const struct rmarea_params *par,
+                struct merge_plan *plan)
+{
+    struct plan_state s;
+    struct area_graph graph;
+    struct plan_step step;
+    const struct adj_edge *edges;
+    int i, area, nareas, nedges, neighbour, nchecked;
+
+    plan->steps = NULL;
+    plan->n = plan->alloc = 0;
+
+    s.Map = Map;
+    s.par = par;
+    nareas = Vect_get_num_areas(Map);
+    s.parent = G_malloc((nareas + 1) * sizeof(int));
+    s.outer = G_calloc(nareas + 1, sizeof(struct plan_list));
+    s.inner = G_calloc(nareas + 1, sizeof(struct plan_list));
+    nbmap_init(&s.nbmap);
+    s.Deferred = G_new_ilist();
+
+    graph_init(&graph, Map, 0);
+    metrics_init(&s.metrics, Map, &graph, par->layer, par->classes,
+                 par->sizes, 0);
+
+    G_message(_("Collecting neighbours..."));
+    for (area = 1; area <= nareas; area++) {
+        G_percent(area, nareas, 2);
+        s.parent[area] = area;
+        if (!Vect_area_alive(Map, area))
+            continue;
+
+        edges = graph_get_edges(&graph, area, &nedges);
+        for (i = 0; i < nedges; i++) {
+            neighbour = edges[i].neighbour;
+            if (neighbour < 0) {
+                /* the area around the isle, none for the outer world */
+                neighbour = Vect_get_isle_area(Map, -neighbour);
+                if (neighbour <= 0)
+                    continue;
+                list_add(&s.inner[neighbour], area, 0);
+                neighbour = -neighbour;
+            }
+            if (neighbour == 0 || neighbour == area)
+                continue;
+            list_add(&s.outer[area], neighbour, edges[i].length);
+        }
+    }
+    graph_free(&graph);
+
+    worklist_init(&s.wl, par->order == ORDER_SIZE);
+    for (area = 1; area <= nareas; area++) {
+        if (Vect_area_alive(Map, area))
+            plan_queue(&s, area);
+    }
+
+    G_message(_("Computing merges..."));
+    for (s.stage = 1; s.stage <= 2; s.stage++) {
+        if (s.stage == 2) {
+            /* regions without identical neighbour, as in the native
+             * version */
+            if (!par->fallback)
+                break;
+            for (i = 0; i < s.Deferred->n_values; i++) {
+                area = s.Deferred->value[i];
+                if (s.parent[area] == area)
+                    plan_queue(&s, area);
+            }
+        }
+
+        nchecked = 0;
+        while ((area = worklist_pop(&s.wl)) > 0) {
+            nchecked++;
+            G_percent(nchecked, nchecked + worklist_size(&s.wl), 1);
+
+            if (plan_evaluate(&s, area, &step)) {
+                plan_add_step(plan, &step);
+                plan_commit(&s, &step);
+            }
+        }
+    }
+    par->stats->passes++;
+
+    G_message(_("%d areas would be removed"), plan->n);
+
+    for (area = 1; area <= nareas; area++) {
+        list_free(&s.outer[area]);
+        list_free(&s.inner[area]);
+    }
+    G_free(s.outer);
+    G_free(s.inner);
+    G_free(s.parent);
+    nbmap_free(&s.nbmap);
+    G_free_ilist(s.Deferred);
+    worklist_free(&s.wl);
+    metrics_free(&s.metrics);
+
+    return plan->n;
+}
+
+void plan_free(struct merge_plan *plan)
+{
+    G_free(plan->steps);
+    plan->steps = NULL;
+    plan->n = plan->alloc = 0;
+}
+
+/*!
+   \brief Write the merges as CSV
+
+   \param plan merges
+   \param file name of the output file, "-" for stdout
+ */
+void plan_write_csv(const struct merge_plan *plan, const char *file)
+{
+    FILE *fp;
+    int i;
+
+    if (strcmp(file, "-") == 0)
+        fp = stdout;
+    else if (!(fp = fopen(file, "w")))
+        G_fatal_error(_("Unable to open file <%s> for writing"), file);
+
+    fprintf(fp, "step,area,cat,target_area,target_cat,isle,fallback,"
+                "shared_length,size\n");
+    for (i = 0; i < plan->n; i++) {
+        const struct plan_step *step = &plan->steps[i];
+
+        fprintf(fp, "%d,%d,%d,%d,%d,%d,%d,%.15g,%.15g\n", i + 1,
+                step->area, step->cat, step->target, step->target_cat,
+                step->isle, step->fallback, step->length, step->size);
+    }
+
+    if (fp != stdout)
+        fclose(fp);
+}
@@ -1,8 +1,264 @@
 #define SEP           "--------------------------------------------------"
 
-int remove_small_areas(struct Map_info *Map, double thresh,
-                       struct Map_info *Err, double *removed_area,
-                       int layer, dbCatValArray *cvarr, int nols,
-                       struct cat_list *, int);
+/* merge order */
+#define ORDER_ID   0 /* by area id */
+#define ORDER_SIZE 1 /* smallest area first */
 
-void copy_tabs(struct Map_info *In, struct Map_info *Out);
+/* queue of areas to be checked, see worklist.c */
+struct worklist {
+    int *items;       /* queued areas, heap if ordered by key */
+    double *key;      /* key of queued areas */
+    int head, tail;   /* first queued, next free */
+    int alloc;
+    int by_key;       /* 1 if ordered by key */
+    int *pos;         /* position of an area in items, -1 if not queued */
+    int alloc_pos;
+};
+
+void worklist_init(struct worklist *, int);
+void worklist_free(struct worklist *);
+int worklist_size(const struct worklist *);
+void worklist_push(struct worklist *, int, double);
+int worklist_pop(struct worklist *);
+
+/* neighbours of an area with shared length, see neighbours.c */
+struct neighbour_map {
+    int *slot;      /* hash table of neighbour indices */
+    int size;
+    int *neighbour; /* neighbours in order of first appearance */
+    double *length; /* shared length, accumulated by the caller */
+    int *pos;       /* slot of each neighbour */
+    int n, alloc;
+};
+
+void nbmap_init(struct neighbour_map *);
+void nbmap_free(struct neighbour_map *);
+void nbmap_reset(struct neighbour_map *, int);
+int nbmap_index(struct neighbour_map *, int);
+
+/* adjacency graph of areas, see area_graph.c */
+struct adj_edge {
+    int neighbour;  /* neighbour area (> 0) or isle (< 0) */
+    double length;  /* total length of shared boundaries */
+    int first;      /* index of first shared boundary in lines */
+    int nlines;     /* number of shared boundaries */
+};
+
+struct area_graph {
+    struct Map_info *Map;
+    int alloc_areas;
+    int *first;               /* first edge of an area, -1 if outdated */
+    int *nedges;              /* number of edges of an area */
+    struct adj_edge *edges;
+    int n_edges, alloc_edges;
+    int *lines;               /* boundaries, signed as area boundaries */
+    int n_lines, alloc_lines;
+    int garbage_edges, garbage_lines;
+    double *line_length;      /* boundary length, < 0 if not yet known */
+    int alloc_line_length;
+    int *line_edge;           /* scratch: edge of each boundary */
+    int alloc_line_edge;
+    struct neighbour_map nbmap; /* scratch: edge of each neighbour */
+    struct ilist *List;
+    struct line_pnts *Points;
+};
+
+void graph_init(struct area_graph *, struct Map_info *, int);
+void graph_free(struct area_graph *);
+void graph_invalidate(struct area_graph *, int);
+const struct adj_edge *graph_get_edges(struct area_graph *, int, int *);
+const int *graph_edge_lines(const struct area_graph *,
+                            const struct adj_edge *);
+double graph_line_length(struct area_graph *, int);
+double graph_known_line_length(const struct area_graph *, int);
+void graph_set_line_length(struct area_graph *, int, double);
+
+/* attribute classes of categories, see attr_class.c */
+struct attr_classes {
+    int n;        /* number of categories */
+    int *cat;     /* sorted categories */
+    int *cls;     /* class of each category */
+    int nclasses;
+};
+
+void attr_classes_build(struct attr_classes *, dbCatValArray *, int);
+int attr_classes_select(struct attr_classes *, dbDriver *, const char *,
+                        const char *, char **, int);
+void attr_classes_free(struct attr_classes *);
+int attr_class_get(const struct attr_classes *, int);
+struct rmarea_stats;
+void attr_classes_load(struct attr_classes *, const struct field_info *,
+                       char **, int, int, const struct ilist *,
+                       struct rmarea_stats *);
+
+struct ilist *get_candidate_cats(struct Map_info *, int, double, double **);
+struct ilist *get_changed_areas(struct Map_info *, int, struct cat_list *,
+                                const struct bound_box *, int);
+
+/* cached metrics of areas, see area_metrics.c */
+struct area_info {
+    double size;
+    double perimeter; /* including isles */
+    int cat;          /* centroid category in layer, -1 if none */
+    int cls;          /* attribute class, -1 if none */
+};
+
+struct area_metrics {
+    struct area_info *info;
+    char *known; /* 1 if the metrics of an area have been computed */
+    int alloc;
+    struct Map_info *Map;
+    struct area_graph *graph;
+    int layer;
+    const struct attr_classes *classes;
+    struct ilist *List;
+    struct line_cats *Cats;
+    const double *sizes; /* precomputed sizes of areas by id or NULL */
+    int nsizes;          /* number of areas when sizes were computed */
+};
+
+void metrics_init(struct area_metrics *, struct Map_info *,
+                  struct area_graph *, int, const struct attr_classes *,
+                  const double *, int);
+void metrics_free(struct area_metrics *);
+struct area_info *metrics_get(struct area_metrics *, int);
+void metrics_compute(struct area_metrics *, int);
+void metrics_compute_batch(struct area_metrics *, const int *, int);
+void metrics_merge(struct area_metrics *, int, int, int, double);
+
+/* merges applied by a run, see merge_log.c */
+struct topo_fingerprint {
+    int nodes, lines, boundaries, centroids, areas, isles;
+    unsigned int checksum; /* of line topology and node coordinates */
+    struct bound_box box;
+};
+
+struct merge_log {
+    struct topo_fingerprint fp; /* map the merges were applied to */
+    int *area;      /* removed area */
+    int *neighbour; /* area (> 0) or isle (< 0) it was merged with */
+    int *first;     /* index of first deleted boundary in lines */
+    int *nlines;    /* number of deleted boundaries */
+    int n, alloc;
+    int *lines;     /* deleted boundaries */
+    int n_lines, alloc_lines;
+};
+
+void merge_log_init(struct merge_log *);
+void merge_log_free(struct merge_log *);
+void merge_log_add(struct merge_log *, int, int, const int *, int);
+void merge_log_fingerprint(struct Map_info *, struct topo_fingerprint *);
+int merge_log_check(const struct merge_log *, struct Map_info *);
+void merge_log_write(const struct merge_log *, const char *);
+void merge_log_read(struct merge_log *, const char *);
+
+/* counters of a run, for the report */
+struct rmarea_stats {
+    int passes;               /* calls of remove_small_areas() */
+    long examined;            /* areas checked for removal */
+    long skipped_threshold;   /* larger than threshold */
+    long skipped_constraint;  /* category not selected */
+    long skipped_neighbour;   /* no neighbour with identical attributes */
+    long merged_area;         /* merged with an adjacent area */
+    long merged_isle;         /* merged with the area around an isle */
+    long merged_fallback;     /* merged with different attributes */
+    long boundaries_deleted;
+    double size_removed;
+    long attr_comparisons;    /* comparisons of attributes of two areas */
+    double attr_time;         /* time spent comparing attribute values */
+};
+
+/* thresholds of categories, see thresholds.c */
+struct cat_thresholds {
+    int n;          /* number of categories */
+    int *cat;       /* sorted categories */
+    double *thresh; /* threshold of each category */
+    double max;     /* largest threshold, including the default */
+};
+
+void cat_thresholds_load(struct cat_thresholds *, const struct field_info *,
+                         const char *, const char *, const char *, double);
+void cat_thresholds_free(struct cat_thresholds *);
+
+/* settings for remove_small_areas() */
+struct rmarea_params {
+    double thresh;                      /* maximum size of removed areas */
+    const struct cat_thresholds *cat_thresh; /* thresholds of categories,
+                                                NULL for thresh only */
+    int layer;                          /* layer of categories */
+    const struct attr_classes *classes; /* attribute classes */
+    struct cat_list *cat_list;          /* category constraint or NULL */
+    int at_boundary; /* only remove areas with a different neighbour */
+    int fallback;    /* merge areas without identical neighbour with
+                        another neighbour in a second stage */
+    const struct attr_classes *relaxed; /* in the second stage only with
+                                           identical classes or NULL */
+    int order;       /* ORDER_ID or ORDER_SIZE */
+    int nprocs;      /* number of threads to evaluate areas */
+    struct rmarea_stats *stats; /* counters, updated */
+    struct merge_log *record;   /* merges are appended or NULL */
+    const struct merge_log *replay; /* merges to apply instead or NULL */
+    const struct ilist *seeds; /* only these areas are checked first,
+                                  NULL for all areas */
+    const double *sizes; /* sizes of the areas of the map as passed, by
+                            id, or NULL */
+};
+
+double area_threshold(const struct rmarea_params *, int);
+
+int remove_small_areas(struct Map_info *Map, struct Map_info *Err,
+                       double *removed_area, const struct rmarea_params *,
+                       struct ilist *);
+
+int merge_boundaries_at_nodes(struct Map_info *, struct ilist *,
+                              struct Map_info *);
+
+struct dblinks *get_dblinks(struct Map_info *In);
+void copy_tabs(const struct dblinks *Links, struct Map_info *Map,
+               struct Map_info *Out);
+
+int clone_native_map(struct Map_info *In, struct Map_info *Out, int field);
+
+/* merges computed without changing the geometry, see plan.c */
+struct plan_step {
+    int area;       /* removed area */
+    int cat;        /* category of the removed area */
+    int target;     /* area it is merged with */
+    int target_cat; /* category of the target */
+    int isle;       /* 1 if merged through an isle of the target */
+    int fallback;   /* 1 if the target has different attributes */
+    double length;  /* length of the shared boundaries */
+    double size;    /* size of the removed area */
+};
+
+struct merge_plan {
+    struct plan_step *steps; /* in the order they are applied */
+    int n, alloc;
+};
+
+int plan_merges(struct Map_info *, const struct rmarea_params *,
+                struct merge_plan *);
+void plan_free(struct merge_plan *);
+void plan_write_csv(const struct merge_plan *, const char *);
+
+/* wall time of the phases of a run, see timing.c */
+enum phase {
+    PHASE_ATTRIBUTES,
+    PHASE_COPY,
+    PHASE_REMOVE,
+    PHASE_MERGE_LINES,
+    PHASE_WRITE,
+    PHASE_BUILD,
+    PHASE_TABLES,
+    PHASE_TOTAL,
+    N_PHASES
+};
+
+double timer_now(void);
+void phase_start(int);
+void phase_stop(int);
+double phase_time(int);
+const char *phase_name(int);
+void phase_report(void);
+
+void write_report(const char *, const struct rmarea_stats *, int, double);
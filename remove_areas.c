@@ -14,24 +14,23 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 #include <grass/vector.h>
 #include <grass/dbmi.h>
 #include <grass/glocale.h>
 
+#include "proto.h"
+
 /* compare attributes
  * return 0 identical
  * return 1 not identical
  */
 
 static int comp_attrs(struct line_cats *ACats, struct line_cats *BCats,
-                      dbCatValArray *cvarr, int layer, int ncols)
+                      const struct attr_classes *classes, int layer)
 {
-    int i;
     int acat, bcat;
-    int ai, bi;
-    double ad, bd;
-    char *as, *bs;
-    dbCatVal *acatval, *bcatval;
+    int acls;
 
     acat = -1;
     Vect_cat_get(ACats, layer, &acat);
@@ -43,48 +42,20 @@ static int comp_attrs(struct line_cats *ACats, struct line_cats *BCats,
     if (bcat < 0)
         return 1;
 
-    for (i = 0; i < ncols; i++) {
-        db_CatValArray_get_value(&cvarr[i], acat, &acatval);
-        db_CatValArray_get_value(&cvarr[i], bcat, &bcatval);
-
-        if (cvarr[i].ctype == DB_C_TYPE_INT) {
-            ai = acatval->val.i;
-            bi = bcatval->val.i;
-            if (ai != bi)
-                return 1;
-        }
-        else if (cvarr[i].ctype == DB_C_TYPE_DOUBLE) {
-            ad = acatval->val.d;
-            bd = bcatval->val.d;
-            if (ad != bd)
-                return 1;
-        }
-        else if (cvarr[i].ctype == DB_C_TYPE_STRING) {
-            as = db_get_string(acatval->val.s);
-            bs = db_get_string(bcatval->val.s);
-            if (!as && bs)
-                return 1;
-            if (as && !bs)
-                return 1;
-            if (as && bs && strcmp(as, bs) != 0)
-                return 1;
-        }
-        else {
-            return 1;
-        }
-    }
+    acls = attr_class_get(classes, acat);
+    if (acls < 0 || acls != attr_class_get(classes, bcat))
+        return 1;
 
     G_debug(3, "attributes are identical");
 
     return 0;
 }
 
+int remove_small_areas_nat(struct Map_info *, struct Map_info *, double *,
+                           const struct rmarea_params *, struct ilist *);
 
-int remove_small_areas_nat(struct Map_info *, double, struct Map_info *,
-                           double *, int, dbCatValArray *, int, struct cat_list *, int);
-
-int remove_small_areas_ext(struct Map_info *, double, struct Map_info *,
-                           double *, int, dbCatValArray *, int, struct cat_list *, int);
+int remove_small_areas_ext(struct Map_info *, struct Map_info *, double *,
+                           const struct rmarea_params *, struct ilist *);
 
 /*!
    \brief Remove small areas from the map map.
@@ -93,31 +64,44 @@ int remove_small_areas_ext(struct Map_info *, double, struct Map_info *,
    removed.  Map topology must be built GV_BUILD_CENTROIDS.
 
    \param[in,out] Map vector map
-   \param thresh maximum area size for removed areas
    \param[out] Err vector map where removed lines and centroids are written
    \param removed_area  pointer to where total size of removed area is stored or
    NULL
+   \param par settings: threshold, layer, attribute classes of the
+   categories (areas are only merged with neighbours of the same class),
+   category constraint, order (ORDER_ID or ORDER_SIZE) and number of
+   threads (the last two for native format only); the counters in
+   par->stats are updated; merges applied are recorded in par->record,
+   with par->replay the recorded merges are applied instead of checking
+   areas (native format only)
+   \param[out] Nodes list where end nodes of removed boundaries are added or
+   NULL (native format only)
 
    \return number of removed areas
  */
 
-int remove_small_areas(struct Map_info *Map, double thresh,
-                       struct Map_info *Err, double *removed_area,
-                       int layer, dbCatValArray *cvarr, int ncols,
-                       struct cat_list *cat_list, int at_boundary)
+int remove_small_areas(struct Map_info *Map, struct Map_info *Err,
+                       double *removed_area, const struct rmarea_params *par,
+                       struct ilist *Nodes)
 {
+    par->stats->passes++;
 
     if (Map->format == GV_FORMAT_NATIVE)
-        return remove_small_areas_nat(Map, thresh, Err, removed_area, layer, cvarr, ncols, cat_list, at_boundary);
+        return remove_small_areas_nat(Map, Err, removed_area, par, Nodes);
     else
-        return remove_small_areas_ext(Map, thresh, Err, removed_area, layer, cvarr, ncols, cat_list, at_boundary);
+        return remove_small_areas_ext(Map, Err, removed_area, par, Nodes);
 }
 
-int remove_small_areas_ext(struct Map_info *Map, double thresh,
-                           struct Map_info *Err, double *removed_area,
-                           int layer, dbCatValArray *cvarr, int ncols,
-                           struct cat_list *cat_list, int at_boundary)
+int remove_small_areas_ext(struct Map_info *Map, struct Map_info *Err,
+                           double *removed_area,
+                           const struct rmarea_params *par,
+                           struct ilist *Nodes)
 {
+    int layer = par->layer;
+    const struct attr_classes *classes = par->classes;
+    struct cat_list *cat_list = par->cat_list;
+    int at_boundary = par->at_boundary;
+    struct rmarea_stats *stats = par->stats;
     int area, nareas;
     int nremoved = 0;
     struct ilist *List;
@@ -127,18 +111,20 @@ int remove_small_areas_ext(struct Map_info *Map, double thresh,
     struct line_cats *BCats;
     double size_removed = 0.0;
     int different_neighbors;
-    int i, j;
+    struct neighbour_map nbmap;
+    int i;
 
     List = Vect_new_list();
     AList = Vect_new_list();
     Points = Vect_new_line_struct();
     ACats = Vect_new_cats_struct();
     BCats = Vect_new_cats_struct();
+    nbmap_init(&nbmap);
 
     nareas = Vect_get_num_areas(Map);
     for (area = 1; area <= nareas; area++) {
-        int centroid, ncentroid, dissolve_neighbour;
-        double length, l, size, nsize;
+        int centroid, ncentroid, dissolve_neighbour, cat;
+        double length, size, nsize;
         int narea;
 
         G_percent(area, nareas, 1);
@@ -151,24 +137,32 @@ int remove_small_areas_ext(struct Map_info *Map, double thresh,
         if (!centroid)
             continue;
 
+        stats->examined++;
+        Vect_read_line(Map, NULL, ACats, centroid);
+        if (!Vect_cat_get(ACats, layer, &cat))
+            cat = -1;
+
         size = Vect_get_area_area(Map, area);
-        if (size > thresh)
+        if (size > area_threshold(par, cat)) {
+            stats->skipped_threshold++;
             continue;
+        }
 
-        Vect_read_line(Map, NULL, ACats, centroid);
-
-        if (layer > 0 && !Vect_cats_in_constraint(ACats, layer, cat_list))
+        if (layer > 0 && !Vect_cats_in_constraint(ACats, layer, cat_list)) {
+            stats->skipped_constraint++;
             continue;
+        }
 
         /* Find adjacent areas with identical attributes */
 
         Vect_get_area_boundaries(Map, area, List);
         different_neighbors = 0;
 
-        /* Create a list of neighbour areas */
-        Vect_reset_list(AList);
+        /* Accumulate the shared boundary length of each neighbour
+         * with identical attributes in one pass */
+        nbmap_reset(&nbmap, List->n_values);
         for (i = 0; i < List->n_values; i++) {
-            int line, left, right, neighbour;
+            int line, left, right, neighbour, n, k;
 
             line = List->value[i];
 
@@ -184,65 +178,63 @@ int remove_small_areas_ext(struct Map_info *Map, double thresh,
             G_debug(4, "  line = %d left = %d right = %d neighbour = %d", line,
                     left, right, neighbour);
 
-            /* use only neighbour areas with identical attributes */
-            ncentroid = Vect_get_area_centroid(Map, neighbour);
-            if (ncentroid != 0) {
-                Vect_read_line(Map, NULL, BCats, ncentroid);
-                if (comp_attrs(ACats, BCats, cvarr, layer, ncols) == 0) {
-                    Vect_list_append(AList, neighbour); /* this checks for duplicity */
-                }
-                else {
-                    /* neighbor with different attributes */
-                    different_neighbors++;
+            n = nbmap.n;
+            k = nbmap_index(&nbmap, neighbour);
+            if (k == n) {
+                /* use only neighbour areas with identical attributes */
+                nbmap.length[k] = -1.0;
+                ncentroid = Vect_get_area_centroid(Map, neighbour);
+                if (ncentroid != 0) {
+                    int different;
+
+                    Vect_read_line(Map, NULL, BCats, ncentroid);
+                    different = comp_attrs(ACats, BCats, classes, layer);
+                    stats->attr_comparisons++;
+                    if (!different) {
+                        nbmap.length[k] = 0.0;
+                    }
+                    else {
+                        /* neighbor with different attributes */
+                        different_neighbors++;
+                    }
                 }
             }
-            Vect_list_append(AList, neighbour); /* this checks for duplicity */
+            if (nbmap.length[k] >= 0) {
+                Vect_read_line(Map, Points, NULL, abs(line));
+                nbmap.length[k] += Vect_line_length(Points);
+            }
         }
-        G_debug(3, "num neighbours = %d", AList->n_values);
+        G_debug(3, "num neighbours = %d", nbmap.n);
 
         /* only dissolve areas if there is at least one different neighbor
          * enforces dissolving only along boundaries of reference areas */
-        if (at_boundary && !different_neighbors)
+        if (at_boundary && !different_neighbors) {
+            stats->skipped_neighbour++;
             continue;
+        }
 
-        /* Go through the list of neighbours and find that with the longest
-         * boundary */
+        /* Find the neighbour with the longest boundary */
         dissolve_neighbour = 0;
         length = -1.0;
-        for (i = 0; i < AList->n_values; i++) {
-            int neighbour1;
-
-            l = 0.0;
-            neighbour1 = AList->value[i];
-            G_debug(4, "   neighbour1 = %d", neighbour1);
-
-            for (j = 0; j < List->n_values; j++) {
-                int line, left, right, neighbour2;
-
-                line = List->value[j];
-                Vect_get_line_areas(Map, abs(line), &left, &right);
-                if (line > 0)
-                    neighbour2 = left;
-                else
-                    neighbour2 = right;
-
-                if (neighbour2 == neighbour1) {
-                    Vect_read_line(Map, Points, NULL, abs(line));
-                    l += Vect_line_length(Points);
-                }
-            }
-            if (l > length) {
-                length = l;
-                dissolve_neighbour = neighbour1;
+        for (i = 0; i < nbmap.n; i++) {
+            if (nbmap.length[i] > length) {
+                length = nbmap.length[i];
+                dissolve_neighbour = nbmap.neighbour[i];
             }
         }
 
-        if (dissolve_neighbour == 0)
+        if (dissolve_neighbour == 0) {
+            stats->skipped_neighbour++;
             continue;
+        }
 
         G_debug(3, "dissolve_neighbour = %d", dissolve_neighbour);
 
         size_removed += size;
+        if (dissolve_neighbour > 0)
+            stats->merged_area++;
+        else
+            stats->merged_isle++;
 
         /* choose centroid to remove */
         if (dissolve_neighbour > 0) {
@@ -318,10 +310,13 @@ int remove_small_areas_ext(struct Map_info *Map, double thresh,
             }
             Vect_delete_line(Map, line);
         }
+        stats->boundaries_deleted += AList->n_values;
 
         nremoved++;
         nareas = Vect_get_num_areas(Map);
     }
+    nbmap_free(&nbmap);
+    stats->size_removed += size_removed;
 
     if (removed_area)
         *removed_area = size_removed;
@@ -331,489 +326,932 @@ int remove_small_areas_ext(struct Map_info *Map, double thresh,
     return (nremoved);
 }
 
-/* much faster version */
-int remove_small_areas_nat(struct Map_info *Map, double thresh,
-                           struct Map_info *Err, double *removed_area,
-                           int layer, dbCatValArray *cvarr, int ncols,
-                           struct cat_list *cat_list, int at_boundary)
-{
-    int area, nareas;
-    int nremoved = 0;
-    struct ilist *List;
-    struct ilist *AList;
-    struct ilist *BList;
-    struct ilist *NList;
-    struct ilist *IList;
+/* state of the native version */
+struct rmarea_engine {
+    struct Map_info *Map;
+    struct Map_info *Err;
+    const struct rmarea_params *par;
+    struct area_graph graph;
+    struct area_metrics metrics;
+    struct worklist wl;
+    struct ilist *AList, *BList, *NList, *IList;
     struct line_pnts *Points;
     struct line_cats *ACats;
-    struct line_cats *BCats;
-    double size_removed = 0.0;
-    int dissolve_neighbour, different_neighbors;
-    int line, left, right, neighbour;
-    int nisles, nnisles;
-    int i, j;
+    struct ilist *Nodes;
+    int boundary_cats; /* 1 if categories of boundaries are indexed */
+    int nremoved;
+    double size_removed;
+    int stage;             /* 2 if merging with any neighbour */
+    struct ilist *Deferred; /* areas without identical neighbour */
+};
+
+/* merge decision for a small area */
+struct merge {
+    int area;      /* area to be removed */
+    int neighbour; /* area (> 0) or isle (< 0) to merge with, 0 for none */
+    int edge;      /* edge of area shared with neighbour */
+    double length; /* length of the shared boundaries */
+    int ncompared; /* number of neighbours whose attributes were compared */
+    int fallback;  /* 1 if the neighbour has different attributes */
+};
+
+/* outcome of checking an area */
+enum {
+    CHECK_SKIP,         /* dead area or area without centroid */
+    CHECK_THRESHOLD,    /* larger than threshold */
+    CHECK_CONSTRAINT,   /* category not selected */
+    CHECK_NO_NEIGHBOUR, /* no neighbour to merge with */
+    CHECK_MERGE,        /* to be merged */
+    CHECK_DEFERRED      /* decided again later */
+};
+
+/* area of a neighbour, the area around an isle */
+static int neighbour_area(struct Map_info *Map, int neighbour)
+{
+    if (neighbour < 0)
+        return Vect_get_isle_area(Map, -neighbour);
 
-    List = Vect_new_list();
-    AList = Vect_new_list();
-    BList = Vect_new_list();
-    NList = Vect_new_list();
-    IList = Vect_new_list();
-    Points = Vect_new_line_struct();
-    ACats = Vect_new_cats_struct();
-    BCats = Vect_new_cats_struct();
+    return neighbour;
+}
 
-    nareas = Vect_get_num_areas(Map);
-    for (area = 1; area <= nareas; area++) {
-        int centroid, ncentroid;
-        double length, l, size, nsize;
-        int outer_area = -1;
-        int narea;
+static void queue_area(struct rmarea_engine *e, int area)
+{
+    double key;
 
-        G_percent(area, nareas, 1);
-        G_debug(3, "area = %d", area);
-        if (!Vect_area_alive(Map, area))
-            continue;
+    /* areas without centroid are never removed */
+    if (area <= 0 || !Vect_get_area_centroid(e->Map, area))
+        return;
 
-        /* area must have a category */
-        centroid = Vect_get_area_centroid(Map, area);
-        if (!centroid)
-            continue;
+    key = 0;
+    if (e->par->order == ORDER_SIZE) {
+        metrics_compute(&e->metrics, area);
+        key = e->metrics.info[area].size;
+    }
 
-        size = Vect_get_area_area(Map, area);
-        if (size > thresh)
-            continue;
+    worklist_push(&e->wl, area, key);
+}
 
-        Vect_read_line(Map, NULL, ACats, centroid);
+/* queue an area and all areas sharing a boundary with it,
+ * including the areas inside its isles and the area around it,
+ * and mark their adjacency as outdated */
+static void queue_area_neighbours(struct rmarea_engine *e, int area)
+{
+    struct Map_info *Map = e->Map;
+    struct ilist *List = e->NList;
+    int i, j, nisles, left, right;
 
-        if (layer > 0 && !Vect_cats_in_constraint(ACats, layer, cat_list))
-            continue;
+    if (area <= 0 || !Vect_area_alive(Map, area))
+        return;
 
-        /* Find adjacent areas with identical attributes */
+    graph_invalidate(&e->graph, area);
+    queue_area(e, area);
 
-        Vect_get_area_boundaries(Map, area, List);
-        different_neighbors = 0;
+    nisles = Vect_get_area_num_isles(Map, area);
+    for (j = -1; j < nisles; j++) {
+        if (j < 0)
+            Vect_get_area_boundaries(Map, area, List);
+        else
+            Vect_get_isle_boundaries(Map, Vect_get_area_isle(Map, area, j),
+                                     List);
 
-        /* Create a list of neighbour areas */
-        Vect_reset_list(AList);
         for (i = 0; i < List->n_values; i++) {
+            Vect_get_line_areas(Map, abs(List->value[i]), &left, &right);
+            left = neighbour_area(Map, left);
+            right = neighbour_area(Map, right);
+            /* their adjacency refers to the old areas and isles */
+            graph_invalidate(&e->graph, left);
+            graph_invalidate(&e->graph, right);
+            queue_area(e, left);
+            queue_area(e, right);
+        }
+    }
+}
 
-            line = List->value[i];
+/* update the adjacency of an area and compute the metrics of the area
+ * and its neighbours as needed by evaluate_area() */
+static void prepare_area(struct rmarea_engine *e, int area)
+{
+    const struct adj_edge *edges;
+    int i, nedges;
 
-            if (!Vect_line_alive(Map, abs(line))) /* Should not happen */
-                G_fatal_error(_("Area is composed of dead boundary"));
+    if (!Vect_area_alive(e->Map, area))
+        return;
 
-            Vect_get_line_areas(Map, abs(line), &left, &right);
-            if (line > 0)
-                neighbour = left;
-            else
-                neighbour = right;
+    metrics_compute(&e->metrics, area);
+    edges = graph_get_edges(&e->graph, area, &nedges);
+    for (i = 0; i < nedges; i++)
+        metrics_compute(&e->metrics,
+                        neighbour_area(e->Map, edges[i].neighbour));
+}
 
-            G_debug(4, "  line = %d left = %d right = %d neighbour = %d", line,
-                    left, right, neighbour);
+/* as prepare_area() for many areas, with lengths and sizes computed in
+ * parallel */
+static void prepare_batch(struct rmarea_engine *e, const int *areas, int n)
+{
+    const struct adj_edge *edges;
+    struct ilist *List = e->NList;
+    int i, j, nedges, narea;
 
-            ncentroid = 0;
-            if (neighbour > 0) {
-                ncentroid = Vect_get_area_centroid(Map, neighbour);
-            }
-            if (neighbour < 0) {
-                narea = Vect_get_isle_area(Map, -neighbour);
-                if (narea > 0)
-                    ncentroid = Vect_get_area_centroid(Map, narea);
-            }
-            /* use only neighbour areas with identical attributes */
-            if (ncentroid != 0) {
-                Vect_read_line(Map, NULL, BCats, ncentroid);
-                if (comp_attrs(ACats, BCats, cvarr, layer, ncols) == 0) {
-                    Vect_list_append(AList, neighbour); /* this checks for duplicity */
-                }
-                else {
-                    /* neighbor with different attributes */
-                    different_neighbors++;
-                }
-            }
+    metrics_compute_batch(&e->metrics, areas, n);
 
+    List->n_values = 0;
+    for (i = 0; i < n; i++) {
+        if (!Vect_area_alive(e->Map, areas[i]))
+            continue;
+        edges = graph_get_edges(&e->graph, areas[i], &nedges);
+        for (j = 0; j < nedges; j++) {
+            narea = neighbour_area(e->Map, edges[j].neighbour);
+            if (narea > 0 && !e->metrics.known[narea])
+                G_ilist_add(List, narea);
         }
-        G_debug(3, "num neighbours = %d", AList->n_values);
+    }
+    metrics_compute_batch(&e->metrics, List->value, List->n_values);
+}
 
-        /* only dissolve areas if there is at least one different neighbor
-         * enforces dissolving only along boundaries of reference areas */
-        if (at_boundary && !different_neighbors)
+/* Find the adjacent area with identical attributes and the longest shared
+ * boundary. Only reads topology and the cached graph and metrics, the
+ * edges of the area must be up to date.
+ * return CHECK_MERGE if the area is to be merged
+ * return the reason why it is not merged otherwise */
+static int evaluate_area(struct rmarea_engine *e, int area, struct merge *m)
+{
+    struct Map_info *Map = e->Map;
+    const struct rmarea_params *par = e->par;
+    const struct area_info *info;
+    const struct adj_edge *edges;
+    int i, nedges, neighbour, narea, acls, ncls, different_neighbors;
+    int rcls, fb_neighbour, fb_edge;
+    double fb_length;
+
+    m->area = area;
+    m->neighbour = 0;
+    m->edge = -1;
+    m->length = -1.0;
+    m->ncompared = 0;
+    m->fallback = 0;
+
+    G_debug(3, "area = %d", area);
+    if (!Vect_area_alive(Map, area))
+        return CHECK_SKIP;
+
+    /* area must have a category */
+    if (!Vect_get_area_centroid(Map, area))
+        return CHECK_SKIP;
+
+    info = &e->metrics.info[area];
+    if (info->size > area_threshold(par, info->cat))
+        return CHECK_THRESHOLD;
+
+    if (par->layer > 0 &&
+        (info->cat < 0 || (par->cat_list &&
+                           !Vect_cat_in_cat_list(info->cat, par->cat_list))))
+        return CHECK_CONSTRAINT;
+
+    acls = info->cls;
+    rcls = -1;
+    if (e->stage == 2 && par->relaxed)
+        rcls = attr_class_get(par->relaxed, info->cat);
+
+    edges = graph_get_edges(&e->graph, area, &nedges);
+    different_neighbors = 0;
+    fb_neighbour = 0;
+    fb_edge = -1;
+    fb_length = -1.0;
+    for (i = 0; i < nedges; i++) {
+        neighbour = edges[i].neighbour;
+
+        G_debug(4, "  neighbour = %d boundaries = %d length = %g", neighbour,
+                edges[i].nlines, edges[i].length);
+
+        if (neighbour == area)
             continue;
 
-        /* Go through the list of neighbours and find the one with the longest
-         * boundary */
-        dissolve_neighbour = 0;
-        length = -1.0;
-        for (i = 0; i < AList->n_values; i++) {
-            int neighbour1;
-
-            l = 0.0;
-            neighbour1 = AList->value[i];
-            G_debug(4, "   neighbour1 = %d", neighbour1);
+        narea = neighbour_area(Map, neighbour);
+        if (narea <= 0 || !Vect_get_area_centroid(Map, narea))
+            continue;
 
-            ncentroid = 0;
-            narea = 0;
-            if (neighbour1 > 0) {
-                ncentroid = Vect_get_area_centroid(Map, neighbour1);
-                narea = neighbour1;
+        /* use only neighbour areas with identical attributes */
+        ncls = e->metrics.info[narea].cls;
+        m->ncompared++;
+        if (acls >= 0 && ncls == acls) {
+            if (edges[i].length > m->length) {
+                m->length = edges[i].length;
+                m->neighbour = neighbour;
+                m->edge = i;
             }
-            if (neighbour1 < 0) {
-                narea = Vect_get_isle_area(Map, -neighbour1);
-                if (narea > 0)
-                    ncentroid = Vect_get_area_centroid(Map, narea);
+        }
+        else {
+            /* neighbor with different attributes */
+            different_neighbors++;
+
+            /* in the second stage, any neighbour or one with identical
+             * relaxed attributes */
+            if (e->stage == 2 && edges[i].length > fb_length &&
+                (!par->relaxed ||
+                 (rcls >= 0 && attr_class_get(par->relaxed,
+                                              e->metrics.info[narea].cat) ==
+                                   rcls))) {
+                fb_length = edges[i].length;
+                fb_neighbour = neighbour;
+                fb_edge = i;
             }
+        }
+    }
+    G_debug(3, "num neighbours = %d", nedges);
 
-            for (j = 0; j < List->n_values; j++) {
-                int neighbour2;
+    if (m->neighbour == 0 && fb_neighbour != 0) {
+        m->neighbour = fb_neighbour;
+        m->edge = fb_edge;
+        m->length = fb_length;
+        m->fallback = 1;
+    }
 
-                line = List->value[j];
-                Vect_get_line_areas(Map, abs(line), &left, &right);
-                if (line > 0)
-                    neighbour2 = left;
-                else
-                    neighbour2 = right;
+    /* only dissolve areas if there is at least one different neighbor
+     * enforces dissolving only along boundaries of reference areas */
+    if (par->at_boundary && !different_neighbors)
+        return CHECK_NO_NEIGHBOUR;
 
-                if (neighbour2 == neighbour1) {
-                    Vect_read_line(Map, Points, NULL, abs(line));
-                    l += Vect_line_length(Points);
-                }
-            }
-            if (l > length) {
-                length = l;
-                dissolve_neighbour = neighbour1;
-            }
+    return m->neighbour != 0 ? CHECK_MERGE : CHECK_NO_NEIGHBOUR;
+}
+
+/* update the counters with the outcome of checking an area */
+static void count_check(struct rmarea_engine *e, int check,
+                        const struct merge *m)
+{
+    struct rmarea_stats *stats = e->par->stats;
+
+    if (check == CHECK_SKIP || check == CHECK_DEFERRED)
+        return;
+
+    stats->examined++;
+    stats->attr_comparisons += m->ncompared;
+    if (check == CHECK_THRESHOLD)
+        stats->skipped_threshold++;
+    else if (check == CHECK_CONSTRAINT)
+        stats->skipped_constraint++;
+    else if (check == CHECK_NO_NEIGHBOUR) {
+        stats->skipped_neighbour++;
+        /* checked again in the second stage */
+        if (e->par->fallback && e->stage == 1)
+            G_ilist_add(e->Deferred, m->area);
+    }
+    else if (m->neighbour > 0)
+        stats->merged_area++;
+    else
+        stats->merged_isle++;
+    if (check == CHECK_MERGE && m->fallback)
+        stats->merged_fallback++;
+}
+
+/* merge a small area with its neighbour by deleting the shared boundaries
+ * and updating topology, graph and metrics */
+static void commit_merge(struct rmarea_engine *e, const struct merge *m)
+{
+    struct Map_info *Map = e->Map;
+    struct Map_info *Err = e->Err;
+    struct ilist *AList = e->AList;
+    struct ilist *BList = e->BList;
+    struct ilist *NList = e->NList;
+    struct ilist *IList = e->IList;
+    struct line_pnts *Points = e->Points;
+    struct line_cats *ACats = e->ACats;
+    const struct adj_edge *edges;
+    int area, dissolve_neighbour, centroid, outer_area;
+    int i, j, nedges, line, nisles, nnisles;
+
+    area = m->area;
+    dissolve_neighbour = m->neighbour;
+    outer_area = -1;
+
+    G_debug(3, "dissolve_neighbour = %d", dissolve_neighbour);
+
+    e->size_removed += e->metrics.info[area].size;
+
+    /* because of cats constraints, always remove the centroid of the
+     * small area */
+    centroid = Vect_get_area_centroid(Map, area);
+    if (centroid > 0) {
+        if (Err) {
+            Vect_read_line(Map, Points, ACats, centroid);
+            Vect_write_line(Err, GV_CENTROID, Points, ACats);
         }
+        Vect_delete_line(Map, centroid);
+    }
 
-        if (dissolve_neighbour == 0)
-            continue;
+    /* Make list of boundaries to be removed */
+    edges = graph_get_edges(&e->graph, area, &nedges);
+    Vect_reset_list(AList);
+    Vect_reset_list(BList);
+    for (i = 0; i < nedges; i++) {
+        const int *lines = graph_edge_lines(&e->graph, &edges[i]);
 
-        G_debug(3, "dissolve_neighbour = %d", dissolve_neighbour);
+        for (j = 0; j < edges[i].nlines; j++) {
+            if (i == m->edge)
+                Vect_list_append(AList, abs(lines[j]));
+            else
+                Vect_list_append(BList, lines[j]);
+        }
+    }
+    G_debug(3, "remove %d of %d boundaries", AList->n_values,
+            AList->n_values + BList->n_values);
+    e->par->stats->boundaries_deleted += AList->n_values;
+    if (e->par->record)
+        merge_log_add(e->par->record, area, dissolve_neighbour,
+                      AList->value, AList->n_values);
+
+    /* end nodes of deleted boundaries may be left with two boundaries */
+    if (e->Nodes) {
+        for (i = 0; i < AList->n_values; i++) {
+            struct P_topo_b *topo = Map->plus.Line[AList->value[i]]->topo;
 
-        size_removed += size;
+            G_ilist_add(e->Nodes, topo->N1);
+            G_ilist_add(e->Nodes, topo->N2);
+        }
+    }
 
-        /* choose centroid to remove */
-        if (dissolve_neighbour > 0) {
-            narea = dissolve_neighbour;
+    /* Get isles inside area */
+    Vect_reset_list(IList);
+    if ((nisles = Vect_get_area_num_isles(Map, area)) > 0) {
+        for (i = 0; i < nisles; i++) {
+            Vect_list_append(IList, Vect_get_area_isle(Map, area, i));
         }
-        if (dissolve_neighbour < 0) {
-            narea = Vect_get_isle_area(Map, -dissolve_neighbour);
+    }
+
+    /* Remove boundaries */
+    for (i = 0; i < AList->n_values; i++) {
+        int ret;
+
+        line = AList->value[i];
+
+        if (Err || e->boundary_cats)
+            Vect_read_line(Map, Points, ACats, line);
+        if (Err) {
+            Vect_write_line(Err, GV_BOUNDARY, Points, ACats);
         }
-        nsize = Vect_get_area_area(Map, narea);
+        /* Vect_delete_line(Map, line); */
 
-        if (1 || nsize > size) {
-            /* because of cats constraints, always remove this centroid */
-            /* neighbour is larger, remove this centroid */
-            centroid = Vect_get_area_centroid(Map, area);
-            if (centroid > 0) {
-                if (Err) {
-                    Vect_read_line(Map, Points, ACats, centroid);
-                    Vect_write_line(Err, GV_CENTROID, Points, ACats);
-                }
-                Vect_delete_line(Map, centroid);
-            }
+        /* keep the category index up to date */
+        if (e->boundary_cats) {
+            for (j = 0; j < ACats->n_cats; j++)
+                dig_cidx_del_cat(&(Map->plus), ACats->field[j],
+                                 ACats->cat[j], line, GV_BOUNDARY);
         }
-        else {
-            /* because of cats constraints, the neighbour might not be allowed to be removed */
-            /* neighbour is smaller, remove neighbour */
-            ncentroid = 0;
-            narea = 0;
-            if (dissolve_neighbour > 0) {
-                ncentroid = Vect_get_area_centroid(Map, dissolve_neighbour);
-            }
-            if (dissolve_neighbour < 0) {
-                narea = Vect_get_isle_area(Map, -dissolve_neighbour);
-                if (narea > 0)
-                    ncentroid = Vect_get_area_centroid(Map, narea);
+
+        /* delete the line from coor */
+        ret = V1_delete_line_nat(Map, Map->plus.Line[line]->offset);
+
+        if (ret == -1) {
+            G_fatal_error(_("Could not delete line from coor"));
+        }
+    }
+
+    /* update topo */
+    if (dissolve_neighbour > 0) {
+
+        G_debug(3, "dissolve with neighbour area");
+
+        /* get neighbour centroid */
+        centroid = Vect_get_area_centroid(Map, dissolve_neighbour);
+
+        /* the merged area gets a new id: remove the category index
+         * entries of the neighbour area, those of the small area were
+         * removed together with its centroid */
+        Vect_reset_cats(ACats);
+        if (centroid > 0 && Map->plus.update_cidx)
+            Vect_read_line(Map, NULL, ACats, centroid);
+        for (i = 0; i < ACats->n_cats; i++)
+            dig_cidx_del_cat(&(Map->plus), ACats->field[i], ACats->cat[i],
+                             dissolve_neighbour, GV_AREA);
+        /* get neighbour isles */
+        if ((nnisles = Vect_get_area_num_isles(Map, dissolve_neighbour)) >
+            0) {
+            for (i = 0; i < nnisles; i++) {
+                Vect_list_append(
+                    IList, Vect_get_area_isle(Map, dissolve_neighbour, i));
             }
-            if (ncentroid > 0) {
-                if (Err) {
-                    Vect_read_line(Map, Points, BCats, ncentroid);
-                    Vect_write_line(Err, GV_CENTROID, Points, BCats);
+        }
+
+        /* get neighbour boundaries */
+        Vect_get_area_boundaries(Map, dissolve_neighbour, NList);
+
+        /* delete area from topo */
+        dig_del_area(&(Map->plus), area);
+        /* delete neighbour area from topo */
+        dig_del_area(&(Map->plus), dissolve_neighbour);
+        /* delete boundaries from topo */
+        for (i = 0; i < AList->n_values; i++) {
+            struct P_topo_b *topo;
+            struct P_node *Node;
+
+            line = AList->value[i];
+            topo = (struct P_topo_b *)Map->plus.Line[line]->topo;
+            Node = Map->plus.Node[topo->N1];
+            dig_del_line(&(Map->plus), line, Node->x, Node->y, Node->z);
+        }
+        /* build new area from leftover boundaries of deleted area */
+        for (i = 0; i < BList->n_values; i++) {
+            struct P_topo_b *topo;
+            int new_isle;
+
+            line = BList->value[i];
+            topo = Map->plus.Line[abs(line)]->topo;
+
+            if (topo->left == 0 || topo->right == 0) {
+                new_isle = Vect_build_line_area(
+                    Map, abs(line), (line > 0 ? GV_RIGHT : GV_LEFT));
+                if (new_isle > 0) {
+                    if (outer_area > 0)
+                        G_fatal_error("dissolve_neighbour > 0, new area "
+                                      "has already been created");
+                    outer_area = new_isle;
+                    /* reattach centroid */
+                    Map->plus.Area[outer_area]->centroid = centroid;
+                    if (centroid > 0) {
+                        struct P_topo_c *ctopo =
+                            Map->plus.Line[centroid]->topo;
+
+                        ctopo->area = outer_area;
+                    }
+                }
+                else if (new_isle < 0) {
+                    /* leftover boundary creates a new isle */
+                    Vect_list_append(IList, -new_isle);
+                }
+                else {
+                    /* neither area nor isle, should not happen */
+                    G_fatal_error(_("dissolve_neighbour > 0, failed to "
+                                    "build new area"));
                 }
-                Vect_delete_line(Map, ncentroid);
             }
+            /* check */
+            if (topo->left == 0 || topo->right == 0)
+                G_fatal_error(
+                    _("Dissolve with neighbour area: corrupt topology"));
         }
+        /* build new area from neighbour's boundaries */
+        for (i = 0; i < NList->n_values; i++) {
+            struct P_topo_b *topo;
 
-        /* Make list of boundaries to be removed */
-        Vect_reset_list(AList);
-        Vect_reset_list(BList);
-        for (i = 0; i < List->n_values; i++) {
+            line = NList->value[i];
+            if (!Vect_line_alive(Map, abs(line)))
+                continue;
 
-            line = List->value[i];
-            Vect_get_line_areas(Map, abs(line), &left, &right);
-            if (line > 0)
-                neighbour = left;
-            else
-                neighbour = right;
+            topo = Map->plus.Line[abs(line)]->topo;
 
-            G_debug(3, "   neighbour = %d", neighbour);
+            if (topo->left == 0 || topo->right == 0) {
+                int new_isle;
 
-            if (neighbour == dissolve_neighbour) {
-                Vect_list_append(AList, abs(line));
+                new_isle = Vect_build_line_area(
+                    Map, abs(line), (line > 0 ? GV_RIGHT : GV_LEFT));
+                if (new_isle > 0) {
+                    if (outer_area > 0)
+                        G_fatal_error("dissolve_neighbour > 0, new area "
+                                      "has already been created");
+                    outer_area = new_isle;
+                    /* reattach centroid */
+                    Map->plus.Area[outer_area]->centroid = centroid;
+                    if (centroid > 0) {
+                        struct P_topo_c *ctopo =
+                            Map->plus.Line[centroid]->topo;
+
+                        ctopo->area = outer_area;
+                    }
+                }
+                else if (new_isle < 0) {
+                    /* Neigbour's boundary creates a new isle */
+                    Vect_list_append(IList, -new_isle);
+                }
+                else {
+                    /* neither area nor isle, should not happen */
+                    G_fatal_error(_("Failed to build new area"));
+                }
             }
-            else
-                Vect_list_append(BList, line);
+            if (topo->left == 0 || topo->right == 0)
+                G_fatal_error(
+                    _("Dissolve with neighbour area: corrupt topology"));
         }
-        G_debug(3, "remove %d of %d boundaries", AList->n_values,
-                List->n_values);
+    }
+    /* dissolve with outer isle */
+    else if (dissolve_neighbour < 0) {
 
-        /* Get isles inside area */
-        Vect_reset_list(IList);
-        if ((nisles = Vect_get_area_num_isles(Map, area)) > 0) {
-            for (i = 0; i < nisles; i++) {
-                Vect_list_append(IList, Vect_get_area_isle(Map, area, i));
-            }
-        }
+        G_debug(3, "dissolve with outer isle");
 
-        /* Remove boundaries */
+        outer_area = Vect_get_isle_area(Map, -dissolve_neighbour);
+
+        /* get isle boundaries */
+        Vect_get_isle_boundaries(Map, -dissolve_neighbour, NList);
+
+        /* delete area from topo */
+        dig_del_area(&(Map->plus), area);
+        /* delete isle from topo */
+        dig_del_isle(&(Map->plus), -dissolve_neighbour);
+        /* delete boundaries from topo */
         for (i = 0; i < AList->n_values; i++) {
-            int ret;
+            struct P_topo_b *topo;
+            struct P_node *Node;
 
             line = AList->value[i];
+            topo = (struct P_topo_b *)Map->plus.Line[line]->topo;
+            Node = Map->plus.Node[topo->N1];
+            dig_del_line(&(Map->plus), line, Node->x, Node->y, Node->z);
+        }
+        /* build new isle(s) from leftover boundaries */
+        for (i = 0; i < BList->n_values; i++) {
+            struct P_topo_b *topo;
 
-            if (Err) {
-                Vect_read_line(Map, Points, ACats, line);
-                Vect_write_line(Err, GV_BOUNDARY, Points, ACats);
-            }
-            /* Vect_delete_line(Map, line); */
+            line = BList->value[i];
+            topo = Map->plus.Line[abs(line)]->topo;
 
-            /* delete the line from coor */
-            ret = V1_delete_line_nat(Map, Map->plus.Line[line]->offset);
+            if (topo->left == 0 || topo->right == 0) {
+                int new_isle;
 
-            if (ret == -1) {
-                G_fatal_error(_("Could not delete line from coor"));
+                new_isle = Vect_build_line_area(
+                    Map, abs(line), (line > 0 ? GV_RIGHT : GV_LEFT));
+                if (new_isle < 0) {
+                    Vect_list_append(IList, -new_isle);
+                }
+                else {
+                    /* area or nothing should not happen */
+                    G_fatal_error(_("Failed to build new isle"));
+                }
             }
+            /* check */
+            if (topo->left == 0 || topo->right == 0)
+                G_fatal_error(
+                    _("Dissolve with outer isle: corrupt topology"));
         }
 
-        /* update topo */
-        if (dissolve_neighbour > 0) {
+        /* build new isle(s) from old isle's boundaries */
+        for (i = 0; i < NList->n_values; i++) {
+            struct P_topo_b *topo;
 
-            G_debug(3, "dissolve with neighbour area");
+            line = NList->value[i];
+            if (!Vect_line_alive(Map, abs(line)))
+                continue;
 
-            /* get neighbour centroid */
-            centroid = Vect_get_area_centroid(Map, dissolve_neighbour);
-            /* get neighbour isles */
-            if ((nnisles = Vect_get_area_num_isles(Map, dissolve_neighbour)) >
-                0) {
-                for (i = 0; i < nnisles; i++) {
-                    Vect_list_append(
-                        IList, Vect_get_area_isle(Map, dissolve_neighbour, i));
-                }
-            }
+            topo = Map->plus.Line[abs(line)]->topo;
 
-            /* get neighbour boundaries */
-            Vect_get_area_boundaries(Map, dissolve_neighbour, NList);
-
-            /* delete area from topo */
-            dig_del_area(&(Map->plus), area);
-            /* delete neighbour area from topo */
-            dig_del_area(&(Map->plus), dissolve_neighbour);
-            /* delete boundaries from topo */
-            for (i = 0; i < AList->n_values; i++) {
-                struct P_topo_b *topo;
-                struct P_node *Node;
-
-                line = AList->value[i];
-                topo = (struct P_topo_b *)Map->plus.Line[line]->topo;
-                Node = Map->plus.Node[topo->N1];
-                dig_del_line(&(Map->plus), line, Node->x, Node->y, Node->z);
-            }
-            /* build new area from leftover boundaries of deleted area */
-            for (i = 0; i < BList->n_values; i++) {
-                struct P_topo_b *topo;
+            if (topo->left == 0 || topo->right == 0) {
                 int new_isle;
 
-                line = BList->value[i];
-                topo = Map->plus.Line[abs(line)]->topo;
-
-                if (topo->left == 0 || topo->right == 0) {
-                    new_isle = Vect_build_line_area(
-                        Map, abs(line), (line > 0 ? GV_RIGHT : GV_LEFT));
-                    if (new_isle > 0) {
-                        if (outer_area > 0)
-                            G_fatal_error("dissolve_neighbour > 0, new area "
-                                          "has already been created");
-                        outer_area = new_isle;
-                        /* reattach centroid */
-                        Map->plus.Area[outer_area]->centroid = centroid;
-                        if (centroid > 0) {
-                            struct P_topo_c *ctopo =
-                                Map->plus.Line[centroid]->topo;
-
-                            ctopo->area = outer_area;
-                        }
-                    }
-                    else if (new_isle < 0) {
-                        /* leftover boundary creates a new isle */
-                        Vect_list_append(IList, -new_isle);
-                    }
-                    else {
-                        /* neither area nor isle, should not happen */
-                        G_fatal_error(_("dissolve_neighbour > 0, failed to "
-                                        "build new area"));
-                    }
+                new_isle = Vect_build_line_area(
+                    Map, abs(line), (line > 0 ? GV_RIGHT : GV_LEFT));
+                if (new_isle < 0) {
+                    Vect_list_append(IList, -new_isle);
                 }
-                /* check */
-                if (topo->left == 0 || topo->right == 0)
-                    G_fatal_error(
-                        _("Dissolve with neighbour area: corrupt topology"));
-            }
-            /* build new area from neighbour's boundaries */
-            for (i = 0; i < NList->n_values; i++) {
-                struct P_topo_b *topo;
-
-                line = NList->value[i];
-                if (!Vect_line_alive(Map, abs(line)))
-                    continue;
-
-                topo = Map->plus.Line[abs(line)]->topo;
-
-                if (topo->left == 0 || topo->right == 0) {
-                    int new_isle;
-
-                    new_isle = Vect_build_line_area(
-                        Map, abs(line), (line > 0 ? GV_RIGHT : GV_LEFT));
-                    if (new_isle > 0) {
-                        if (outer_area > 0)
-                            G_fatal_error("dissolve_neighbour > 0, new area "
-                                          "has already been created");
-                        outer_area = new_isle;
-                        /* reattach centroid */
-                        Map->plus.Area[outer_area]->centroid = centroid;
-                        if (centroid > 0) {
-                            struct P_topo_c *ctopo =
-                                Map->plus.Line[centroid]->topo;
-
-                            ctopo->area = outer_area;
-                        }
-                    }
-                    else if (new_isle < 0) {
-                        /* Neigbour's boundary creates a new isle */
-                        Vect_list_append(IList, -new_isle);
-                    }
-                    else {
-                        /* neither area nor isle, should not happen */
-                        G_fatal_error(_("Failed to build new area"));
-                    }
+                else {
+                    /* area or nothing should not happen */
+                    G_fatal_error(_("Failed to build new isle"));
                 }
-                if (topo->left == 0 || topo->right == 0)
-                    G_fatal_error(
-                        _("Dissolve with neighbour area: corrupt topology"));
             }
+            /* check */
+            if (topo->left == 0 || topo->right == 0)
+                G_fatal_error(
+                    _("Dissolve with outer isle: corrupt topology"));
         }
-        /* dissolve with outer isle */
-        else if (dissolve_neighbour < 0) {
-
-            G_debug(3, "dissolve with outer isle");
+    }
 
-            outer_area = Vect_get_isle_area(Map, -dissolve_neighbour);
+    if (dissolve_neighbour > 0 && outer_area <= 0) {
+        G_fatal_error(_("Area merging failed"));
+    }
 
-            /* get isle boundaries */
-            Vect_get_isle_boundaries(Map, -dissolve_neighbour, NList);
+    /* add the category index entries of the merged area */
+    if (dissolve_neighbour > 0) {
+        for (i = 0; i < ACats->n_cats; i++)
+            dig_cidx_add_cat_sorted(&(Map->plus), ACats->field[i],
+                                    ACats->cat[i], outer_area, GV_AREA);
+    }
 
-            /* delete area from topo */
-            dig_del_area(&(Map->plus), area);
-            /* delete isle from topo */
-            dig_del_isle(&(Map->plus), -dissolve_neighbour);
-            /* delete boundaries from topo */
-            for (i = 0; i < AList->n_values; i++) {
-                struct P_topo_b *topo;
-                struct P_node *Node;
+    /* attach all isles to outer or new area */
+    if (outer_area >= 0) {
+        for (i = 0; i < IList->n_values; i++) {
+            if (!Map->plus.Isle[IList->value[i]])
+                continue;
+            Map->plus.Isle[IList->value[i]]->area = outer_area;
+            if (outer_area > 0)
+                dig_area_add_isle(&(Map->plus), outer_area,
+                                  IList->value[i]);
+        }
+    }
 
-                line = AList->value[i];
-                topo = (struct P_topo_b *)Map->plus.Line[line]->topo;
-                Node = Map->plus.Node[topo->N1];
-                dig_del_line(&(Map->plus), line, Node->x, Node->y, Node->z);
-            }
-            /* build new isle(s) from leftover boundaries */
-            for (i = 0; i < BList->n_values; i++) {
-                struct P_topo_b *topo;
+    if (dissolve_neighbour > 0)
+        metrics_merge(&e->metrics, outer_area, area, dissolve_neighbour,
+                      m->length);
+    else
+        metrics_merge(&e->metrics, outer_area, area, outer_area, m->length);
 
-                line = BList->value[i];
-                topo = Map->plus.Line[abs(line)]->topo;
+    /* the merged area and its neighbours must be checked again */
+    graph_invalidate(&e->graph, area);
+    graph_invalidate(&e->graph, dissolve_neighbour);
+    queue_area_neighbours(e, outer_area);
 
-                if (topo->left == 0 || topo->right == 0) {
-                    int new_isle;
+    e->nremoved++;
+}
 
-                    new_isle = Vect_build_line_area(
-                        Map, abs(line), (line > 0 ? GV_RIGHT : GV_LEFT));
-                    if (new_isle < 0) {
-                        Vect_list_append(IList, -new_isle);
-                    }
-                    else {
-                        /* area or nothing should not happen */
-                        G_fatal_error(_("Failed to build new isle"));
-                    }
-                }
-                /* check */
-                if (topo->left == 0 || topo->right == 0)
-                    G_fatal_error(
-                        _("Dissolve with outer isle: corrupt topology"));
+/* evaluate queued areas in parallel, then apply all merges that do not
+ * touch an area read or modified by a merge applied before them */
+static void remove_areas_parallel(struct rmarea_engine *e)
+{
+    struct Map_info *Map = e->Map;
+    int area, i, k, nbatch, alloc_batch, nchecked, round, alloc_marks;
+    int *batch, *found, *read_mark, *mod_mark;
+    struct merge *merges;
+
+    batch = found = read_mark = mod_mark = NULL;
+    merges = NULL;
+    alloc_batch = alloc_marks = 0;
+    nchecked = 0;
+    round = 0;
+
+    while (worklist_size(&e->wl) > 0) {
+        /* collect queued areas */
+        nbatch = 0;
+        while ((area = worklist_pop(&e->wl)) > 0) {
+            if (!Vect_area_alive(Map, area))
+                continue;
+            if (nbatch >= alloc_batch) {
+                alloc_batch = nbatch + 1000 + alloc_batch / 2;
+                batch = G_realloc(batch, alloc_batch * sizeof(int));
+                found = G_realloc(found, alloc_batch * sizeof(int));
+                merges =
+                    G_realloc(merges, alloc_batch * sizeof(struct merge));
             }
+            batch[nbatch++] = area;
+        }
+        G_debug(1, "evaluate %d areas", nbatch);
+
+        /* decision phase: the adjacency and metrics of the areas are
+         * filled in first, geometry is read by one thread and lengths
+         * and sizes are computed in parallel, then the areas are
+         * evaluated reading only */
+        prepare_batch(e, batch, nbatch);
+#if defined(_OPENMP)
+#pragma omp parallel for schedule(dynamic, 64)
+#endif
+        for (i = 0; i < nbatch; i++)
+            found[i] = evaluate_area(e, batch[i], &merges[i]);
+
+        if (Vect_get_num_areas(Map) >= alloc_marks) {
+            int alloc = alloc_marks;
+
+            alloc_marks = Vect_get_num_areas(Map) + 1000 + alloc_marks / 2;
+            read_mark = G_realloc(read_mark, alloc_marks * sizeof(int));
+            mod_mark = G_realloc(mod_mark, alloc_marks * sizeof(int));
+            for (k = alloc; k < alloc_marks; k++)
+                read_mark[k] = mod_mark[k] = 0;
+        }
 
-            /* build new isle(s) from old isle's boundaries */
-            for (i = 0; i < NList->n_values; i++) {
-                struct P_topo_b *topo;
-
-                line = NList->value[i];
-                if (!Vect_line_alive(Map, abs(line)))
-                    continue;
-
-                topo = Map->plus.Line[abs(line)]->topo;
+        /* select independent merges in queue order:
+         * a decision depends on the area and its neighbours,
+         * a merge modifies the area and the neighbour it is merged with */
+        round++;
+        for (i = 0; i < nbatch; i++) {
+            const struct adj_edge *edges;
+            int nedges, narea, conflict;
+
+            if (found[i] != CHECK_MERGE)
+                continue;
+
+            area = batch[i];
+            edges = graph_get_edges(&e->graph, area, &nedges);
+            narea = neighbour_area(Map, merges[i].neighbour);
+            conflict = read_mark[area] == round || read_mark[narea] == round ||
+                       mod_mark[area] == round;
+            for (k = 0; k < nedges && !conflict; k++) {
+                int n = neighbour_area(Map, edges[k].neighbour);
+
+                if (n > 0 && mod_mark[n] == round)
+                    conflict = 1;
+            }
+            if (conflict) {
+                /* decide again in the next round */
+                found[i] = CHECK_DEFERRED;
+                queue_area(e, area);
+                continue;
+            }
 
-                if (topo->left == 0 || topo->right == 0) {
-                    int new_isle;
+            read_mark[area] = mod_mark[area] = round;
+            mod_mark[narea] = round;
+            for (k = 0; k < nedges; k++) {
+                int n = neighbour_area(Map, edges[k].neighbour);
 
-                    new_isle = Vect_build_line_area(
-                        Map, abs(line), (line > 0 ? GV_RIGHT : GV_LEFT));
-                    if (new_isle < 0) {
-                        Vect_list_append(IList, -new_isle);
-                    }
-                    else {
-                        /* area or nothing should not happen */
-                        G_fatal_error(_("Failed to build new isle"));
-                    }
-                }
-                /* check */
-                if (topo->left == 0 || topo->right == 0)
-                    G_fatal_error(
-                        _("Dissolve with outer isle: corrupt topology"));
+                if (n > 0)
+                    read_mark[n] = round;
             }
         }
 
-        if (dissolve_neighbour > 0 && outer_area <= 0) {
-            G_fatal_error(_("Area merging failed"));
+        /* commit phase: sequential */
+        for (i = 0; i < nbatch; i++) {
+            nchecked++;
+            count_check(e, found[i], &merges[i]);
+            if (found[i] == CHECK_MERGE)
+                commit_merge(e, &merges[i]);
         }
+        G_percent(nchecked, nchecked + worklist_size(&e->wl), 1);
+    }
+    G_percent(1, 1, 1);
+
+    G_free(batch);
+    G_free(found);
+    G_free(merges);
+    G_free(read_mark);
+    G_free(mod_mark);
+}
 
-        /* attach all isles to outer or new area */
-        if (outer_area >= 0) {
-            for (i = 0; i < IList->n_values; i++) {
-                if (!Map->plus.Isle[IList->value[i]])
-                    continue;
-                Map->plus.Isle[IList->value[i]]->area = outer_area;
-                if (outer_area > 0)
-                    dig_area_add_isle(&(Map->plus), outer_area,
-                                      IList->value[i]);
+/* apply recorded merges without checking areas, the edge shared with
+ * the recorded neighbour must consist of the recorded boundaries */
+static void replay_merges(struct rmarea_engine *e,
+                          const struct merge_log *log)
+{
+    struct Map_info *Map = e->Map;
+    const struct adj_edge *edges;
+    const int *lines;
+    struct merge m;
+    int i, j, k, nedges;
+
+    for (i = 0; i < log->n; i++) {
+        G_percent(i, log->n, 2);
+
+        m.area = log->area[i];
+        m.neighbour = log->neighbour[i];
+        m.edge = -1;
+        m.ncompared = 0;
+        if (m.area <= 0 || !Vect_area_alive(Map, m.area))
+            G_fatal_error(_("Merge %d of the plan does not match the vector "
+                            "map: area %d does not exist"),
+                          i + 1, m.area);
+
+        prepare_area(e, m.area);
+        edges = graph_get_edges(&e->graph, m.area, &nedges);
+        for (j = 0; j < nedges && m.edge < 0; j++) {
+            if (edges[j].neighbour != m.neighbour ||
+                edges[j].nlines != log->nlines[i])
+                continue;
+            lines = graph_edge_lines(&e->graph, &edges[j]);
+            for (k = 0; k < edges[j].nlines; k++) {
+                if (abs(lines[k]) != log->lines[log->first[i] + k])
+                    break;
             }
+            if (k == edges[j].nlines)
+                m.edge = j;
         }
+        if (m.edge < 0)
+            G_fatal_error(_("Merge %d of the plan does not match the vector "
+                            "map: area %d has no such boundaries with %d"),
+                          i + 1, m.area, m.neighbour);
+        m.length = edges[m.edge].length;
+
+        e->par->stats->examined++;
+        if (m.neighbour > 0)
+            e->par->stats->merged_area++;
+        else
+            e->par->stats->merged_isle++;
+        commit_merge(e, &m);
+    }
+    G_percent(1, 1, 1);
+}
 
-        nremoved++;
-        nareas = Vect_get_num_areas(Map);
+/* check all queued areas and areas queued by merges */
+static void check_queued_areas(struct rmarea_engine *e)
+{
+    struct merge m;
+    int area, check, nchecked;
+
+    if (e->par->nprocs > 1) {
+        remove_areas_parallel(e);
+        return;
     }
 
-    if (removed_area)
-        *removed_area = size_removed;
+    nchecked = 0;
+    while ((area = worklist_pop(&e->wl)) > 0) {
+        nchecked++;
+        G_percent(nchecked, nchecked + worklist_size(&e->wl), 1);
 
-    G_message(_("%d areas of total size %g removed"), nremoved, size_removed);
+        prepare_area(e, area);
+        check = evaluate_area(e, area, &m);
+        count_check(e, check, &m);
+        if (check == CHECK_MERGE)
+            commit_merge(e, &m);
+    }
+}
 
-    Vect_destroy_list(List);
-    Vect_destroy_list(AList);
-    Vect_destroy_list(BList);
-    Vect_destroy_list(NList);
-    Vect_destroy_list(IList);
-    Vect_destroy_line_struct(Points);
-    Vect_destroy_cats_struct(ACats);
-    Vect_destroy_cats_struct(BCats);
+/* much faster version
+ * areas are checked from a worklist: after a merge only the new area and
+ * its neighbours are checked again, thus a single call reaches the same
+ * result as repeated passes over all areas with topology rebuilt in between
+ * with ORDER_SIZE, the smallest queued area is checked first, merged areas
+ * are queued again with their new size */
+int remove_small_areas_nat(struct Map_info *Map, struct Map_info *Err,
+                           double *removed_area,
+                           const struct rmarea_params *par,
+                           struct ilist *Nodes)
+{
+    struct rmarea_engine e;
+    int i, area, nareas;
+
+    e.Map = Map;
+    e.Err = Err;
+    e.par = par;
+    e.AList = Vect_new_list();
+    e.BList = Vect_new_list();
+    e.NList = Vect_new_list();
+    e.IList = Vect_new_list();
+    e.Points = Vect_new_line_struct();
+    e.ACats = Vect_new_cats_struct();
+    e.Nodes = Nodes;
+    e.nremoved = 0;
+    e.stage = 1;
+    e.Deferred = G_new_ilist();
+    e.size_removed = 0.0;
+
+    /* boundaries are deleted from topology directly,
+     * their categories must be removed from the category index */
+    e.boundary_cats = 0;
+    if (Map->plus.update_cidx) {
+        for (i = 0; i < Vect_cidx_get_num_fields(Map); i++) {
+            int field = Vect_cidx_get_field_number(Map, i);
+
+            if (Vect_cidx_get_type_count(Map, field, GV_BOUNDARY) > 0)
+                e.boundary_cats = 1;
+        }
+    }
 
-    return (nremoved);
+    if (par->replay && !merge_log_check(par->replay, Map))
+        G_fatal_error(_("The merge plan was computed for a different "
+                        "topology"));
+    if (par->record)
+        merge_log_fingerprint(Map, &par->record->fp);
+
+    /* adjacency and metrics are computed on demand if only few areas
+     * are checked, and in parallel below with several threads */
+    graph_init(&e.graph, Map, par->seeds || par->replay || par->nprocs > 1);
+    metrics_init(&e.metrics, Map, &e.graph, par->layer, par->classes,
+                 par->sizes, par->seeds || par->replay || par->nprocs > 1);
+
+    worklist_init(&e.wl, par->order == ORDER_SIZE);
+    if (par->seeds) {
+        /* the seeds and their neighbours are checked first, areas changed
+         * by merges are checked as usual */
+        for (i = 0; i < par->seeds->n_values; i++)
+            queue_area_neighbours(&e, par->seeds->value[i]);
+    }
+    else if (!par->replay) {
+        nareas = Vect_get_num_areas(Map);
+        if (par->nprocs > 1) {
+            int *all = G_malloc((nareas + 1) * sizeof(int));
+
+            G_message(_("Computing area sizes..."));
+            for (area = 1; area <= nareas; area++)
+                all[area - 1] = area;
+            prepare_batch(&e, all, nareas);
+            G_free(all);
+        }
+        for (area = 1; area <= nareas; area++) {
+            if (Vect_area_alive(Map, area))
+                queue_area(&e, area);
+        }
+    }
+
+    if (par->replay) {
+        /* areas queued by merges are not checked */
+        replay_merges(&e, par->replay);
+    }
+    else {
+        e.stage = 1;
+        check_queued_areas(&e);
+
+        if (par->fallback && e.Deferred->n_values > 0) {
+            /* second stage: areas without neighbour with identical
+             * attributes are merged with another neighbour */
+            G_verbose_message(_("Checking %d areas without neighbour with "
+                                "identical attributes"),
+                              e.Deferred->n_values);
+            e.stage = 2;
+            for (i = 0; i < e.Deferred->n_values; i++) {
+                if (Vect_area_alive(Map, e.Deferred->value[i]))
+                    queue_area(&e, e.Deferred->value[i]);
+            }
+            check_queued_areas(&e);
+        }
+    }
+
+    if (removed_area)
+        *removed_area = e.size_removed;
+    par->stats->size_removed += e.size_removed;
+
+    G_message(_("%d areas of total size %g removed"), e.nremoved,
+              e.size_removed);
+
+    G_free_ilist(e.Deferred);
+    Vect_destroy_list(e.AList);
+    Vect_destroy_list(e.BList);
+    Vect_destroy_list(e.NList);
+    Vect_destroy_list(e.IList);
+    Vect_destroy_line_struct(e.Points);
+    Vect_destroy_cats_struct(e.ACats);
+    worklist_free(&e.wl);
+    graph_free(&e.graph);
+    metrics_free(&e.metrics);
+
+    return (e.nremoved);
 }
@@ -0,0 +1,91 @@
+/***************************************************************
+ *
+ * MODULE:       v.rmarea
+ *
+ * AUTHOR(S):    Markus Metz
+ *
+ * PURPOSE:      Write a machine readable report of a run
+ *
+ * COPYRIGHT:    (C) 2024 by the GRASS Development Team
+ *
+ *               This program is free software under the
+ *               GNU General Public License (>=v2).
+ *               Read the file COPYING that comes with GRASS
+ *               for details.
+ *
+ **************************************************************/
+#include <stdio.h>
+#include <string.h>
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+#include <grass/gis.h>
+#include <grass/vector.h>
+#include <grass/glocale.h>
+
+#include "proto.h"
+
+/* peak resident set size in KiB, -1 if not known */
+static long peak_rss(void)
+{
+#ifndef _WIN32
+    struct rusage usage;
+
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+        return usage.ru_maxrss;
+#endif
+
+    return -1;
+}
+
+/*!
+   \brief Write counters, phase times and peak memory as JSON
+
+   \param file name of the report file, "-" for stdout
+   \param stats counters of the run
+   \param nremoved number of removed areas
+   \param thresh threshold
+ */
+void write_report(const char *file, const struct rmarea_stats *stats,
+                  int nremoved, double thresh)
+{
+    FILE *fp;
+    int phase;
+
+    if (strcmp(file, "-") == 0)
+        fp = stdout;
+    else if (!(fp = fopen(file, "w")))
+        G_fatal_error(_("Unable to open file <%s> for writing"), file);
+
+    fprintf(fp, "{\n");
+    fprintf(fp, "  \"threshold\": %.15g,\n", thresh);
+    fprintf(fp, "  \"areas_removed\": %d,\n", nremoved);
+    fprintf(fp, "  \"size_removed\": %.15g,\n", stats->size_removed);
+    fprintf(fp, "  \"passes\": %d,\n", stats->passes);
+    fprintf(fp, "  \"areas_examined\": %ld,\n", stats->examined);
+    fprintf(fp, "  \"skipped_threshold\": %ld,\n", stats->skipped_threshold);
+    fprintf(fp, "  \"skipped_constraint\": %ld,\n",
+            stats->skipped_constraint);
+    fprintf(fp, "  \"skipped_no_identical_neighbour\": %ld,\n",
+            stats->skipped_neighbour);
+    fprintf(fp, "  \"merged_with_area\": %ld,\n", stats->merged_area);
+    fprintf(fp, "  \"merged_with_outer_isle\": %ld,\n", stats->merged_isle);
+    fprintf(fp, "  \"merged_with_different_attributes\": %ld,\n",
+            stats->merged_fallback);
+    fprintf(fp, "  \"boundaries_deleted\": %ld,\n",
+            stats->boundaries_deleted);
+    fprintf(fp, "  \"attribute_comparisons\": %ld,\n",
+            stats->attr_comparisons);
+    fprintf(fp, "  \"comp_attrs_seconds\": %.6f,\n", stats->attr_time);
+    fprintf(fp, "  \"phase_seconds\": {\n");
+    for (phase = 0; phase < N_PHASES; phase++)
+        fprintf(fp, "    \"%s\": %.6f%s\n", phase_name(phase),
+                phase_time(phase), phase < N_PHASES - 1 ? "," : "");
+    fprintf(fp, "  },\n");
+    fprintf(fp, "  \"peak_rss_kib\": %ld\n", peak_rss());
+    fprintf(fp, "}\n");
+
+    if (fp != stdout)
+        fclose(fp);
+}
@@ -0,0 +1,236 @@
+#!/usr/bin/env python3
+
+############################################################################
+#
+# MODULE:       v.rmarea benchmark
+# AUTHOR(S):    Markus Metz
+# PURPOSE:      Run v.rmarea on reproducible synthetic coverages and
+#               record the wall time of each phase and the peak memory
+# COPYRIGHT:    (C) 2024 by the GRASS Development Team
+#
+#               This program is free software under the GNU General
+#               Public License (>=v2). Read the file COPYING that
+#               comes with GRASS for details.
+#
+############################################################################
+
+"""Benchmark of v.rmarea on synthetic polygon mosaics.
+
+Must be run in a GRASS session, e.g. with
+
+    grass --tmp-location XY --exec python3 benchmark.py --cells 10000
+
+The mosaic is the Voronoi diagram of points on a lattice, jittered with
+--mode voronoi or regular with --mode grid. Slivers are created by
+adding two points close to both sides of a lattice point, isles by small
+squares next to lattice points. Results are written as CSV, one line per
+run, phase times are taken from the report of v.rmarea.
+"""
+
+import argparse
+import csv
+import json
+import math
+import os
+import random
+import subprocess
+import sys
+import tempfile
+import time
+
+import grass.script as gs
+
+PHASES = ["attributes", "copy", "remove", "merge_lines", "write", "build",
+          "copy_tabs"]
+
+
+def parse_args():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--cells", type=int, nargs="+", default=[10000],
+                        help="number of cells of the mosaic, one run each")
+    parser.add_argument("--mode", choices=["grid", "voronoi"],
+                        default="voronoi", help="cell geometry")
+    parser.add_argument("--slivers", type=float, default=0.05,
+                        help="fraction of cells with a sliver")
+    parser.add_argument("--isles", type=float, default=0.01,
+                        help="fraction of cells with an isle")
+    parser.add_argument("--columns", type=int, default=2,
+                        help="number of attribute columns")
+    parser.add_argument("--cardinality", type=int, default=3,
+                        help="number of distinct values per column")
+    parser.add_argument("--nprocs", type=int, nargs="+", default=[1],
+                        help="number of threads, one run each")
+    parser.add_argument("--repeat", type=int, default=1,
+                        help="number of runs of each configuration")
+    parser.add_argument("--seed", type=int, default=1,
+                        help="seed of the random generator")
+    parser.add_argument("--output", default="-",
+                        help="CSV file for the results, - for stdout")
+    parser.add_argument("--keep", action="store_true",
+                        help="keep the generated maps")
+
+    return parser.parse_args()
+
+
+def write_points(args, ncells, rng, spacing):
+    """Generate the points of the cells and the points with an isle"""
+    cols = int(math.ceil(math.sqrt(ncells)))
+    rows = int(math.ceil(ncells / cols))
+    jitter = 0.25 * spacing if args.mode == "voronoi" else 0.0
+
+    points = []
+    isles = []
+    cat = 0
+    for row in range(rows):
+        for col in range(cols):
+            if cat >= ncells:
+                break
+            x = (col + 0.5) * spacing + rng.uniform(-jitter, jitter)
+            y = (row + 0.5) * spacing + rng.uniform(-jitter, jitter)
+            cat += 1
+            points.append((x, y, cat))
+            if rng.random() < args.slivers:
+                # close points on both sides shrink the cell to a sliver
+                angle = rng.uniform(0, 2 * math.pi)
+                dist = 0.02 * spacing
+                for sign in (-1, 1):
+                    cat += 1
+                    points.append((x + sign * dist * math.cos(angle),
+                                   y + sign * dist * math.sin(angle), cat))
+            elif rng.random() < args.isles:
+                isles.append((x, y))
+
+    return points, isles, rows * spacing, cols * spacing
+
+
+def import_ascii(name, data, fmt, **kwargs):
+    gs.write_command("v.in.ascii", input="-", output=name, format=fmt,
+                     stdin=data, quiet=True, **kwargs)
+
+
+def generate(args, ncells, rng):
+    """Generate a mosaic with attribute table, return name and threshold"""
+    spacing = 100.0
+    name = "bench_%s_%d" % (args.mode, ncells)
+
+    points, isles, north, east = write_points(args, ncells, rng, spacing)
+    gs.run_command("g.region", n=north, s=0, e=east, w=0, res=spacing)
+
+    import_ascii(name + "_pts",
+                 "\n".join("%.6f|%.6f|%d" % p for p in points), "point",
+                 x=1, y=2, cat=3, flags="t")
+    gs.run_command("v.voronoi", input=name + "_pts", output=name + "_cells",
+                   flags="t", quiet=True)
+
+    maps = [name + "_cells"]
+    cat = len(points)
+    if isles:
+        # small squares next to lattice points, inside their cells: the
+        # centroid of a cell is at its lattice point and must stay outside
+        # of the isle, cells extend at least 0.25 * spacing around it
+        half = 0.05 * spacing
+        offset = 0.15 * spacing
+        lines = []
+        for x, y in isles:
+            cat += 1
+            x += offset
+            lines.append("B 5")
+            for dx, dy in ((-1, -1), (1, -1), (1, 1), (-1, 1), (-1, -1)):
+                lines.append(" %.6f %.6f" % (x + dx * half, y + dy * half))
+            lines.append("C 1 1")
+            lines.append(" %.6f %.6f" % (x, y))
+            lines.append(" 1 %d" % cat)
+        import_ascii(name + "_isles", "\n".join(lines), "standard",
+                     flags="n")
+        maps.append(name + "_isles")
+
+    gs.run_command("v.patch", input=maps, output=name, overwrite=True,
+                   quiet=True)
+
+    # attribute table with string columns of the given cardinality
+    columns = ["c%d" % i for i in range(args.columns)]
+    with tempfile.NamedTemporaryFile("w", suffix=".sql",
+                                     delete=False) as sql:
+        sql.write("BEGIN;\n")
+        sql.write("CREATE TABLE %s (cat integer PRIMARY KEY, %s);\n" %
+                  (name, ", ".join("%s varchar(20)" % c for c in columns)))
+        for c in range(1, cat + 1):
+            values = ", ".join("'v%d'" % rng.randrange(args.cardinality)
+                               for _ in columns)
+            sql.write("INSERT INTO %s VALUES (%d, %s);\n" % (name, c, values))
+        sql.write("COMMIT;\n")
+    gs.run_command("db.execute", input=sql.name)
+    os.remove(sql.name)
+    gs.run_command("v.db.connect", map=name, table=name, flags="o",
+                   quiet=True)
+
+    for m in maps + [name + "_pts"]:
+        gs.run_command("g.remove", type="vector", name=m, flags="f",
+                       quiet=True)
+
+    # slivers are 0.02 * spacing wide, isles 0.1 * spacing
+    return name, columns, 0.05 * spacing * spacing
+
+
+def run(name, columns, thresh, nprocs):
+    """Run v.rmarea, return wall time, phase times and peak RSS in KiB"""
+    output = name + "_out"
+    report = tempfile.NamedTemporaryFile(suffix=".json", delete=False)
+    report.close()
+    cmd = ["v.rmarea", "input=" + name, "output=" + output,
+           "columns=" + ",".join(columns), "threshold=%g" % thresh,
+           "nprocs=%d" % nprocs, "report=" + report.name, "--overwrite"]
+
+    start = time.time()
+    proc = subprocess.Popen(cmd, stderr=subprocess.PIPE,
+                            universal_newlines=True)
+    messages = proc.stderr.read()
+    proc.stderr.close()
+    # wait4 gives the resource usage of this child only
+    _, status, usage = os.wait4(proc.pid, 0)
+    wall = time.time() - start
+    if os.WEXITSTATUS(status) != 0:
+        sys.stderr.write(messages)
+        os.remove(report.name)
+        gs.fatal("v.rmarea failed")
+
+    with open(report.name) as fp:
+        phases = json.load(fp)["phase_seconds"]
+    os.remove(report.name)
+
+    gs.run_command("g.remove", type="vector", name=output, flags="f",
+                   quiet=True)
+
+    return wall, phases, usage.ru_maxrss
+
+
+def main():
+    args = parse_args()
+    rng = random.Random(args.seed)
+
+    out = sys.stdout if args.output == "-" else open(args.output, "w")
+    writer = csv.writer(out)
+    writer.writerow(["mode", "cells", "areas", "nprocs", "run", "wall"] +
+                    PHASES + ["peak_rss_kib"])
+
+    for ncells in args.cells:
+        name, columns, thresh = generate(args, ncells, rng)
+        nareas = gs.vector_info_topo(name)["areas"]
+        for nprocs in args.nprocs:
+            for i in range(args.repeat):
+                wall, phases, rss = run(name, columns, thresh, nprocs)
+                writer.writerow([args.mode, ncells, nareas, nprocs, i + 1,
+                                 "%.3f" % wall] +
+                                ["%.3f" % phases[p] for p in PHASES] +
+                                [rss])
+                out.flush()
+        if not args.keep:
+            gs.run_command("g.remove", type="vector", name=name, flags="f",
+                           quiet=True)
+
+    if out is not sys.stdout:
+        out.close()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,83 @@
+#!/usr/bin/env python3
+
+############################################################################
+#
+# MODULE:       v.rmarea category index test
+# AUTHOR(S):    Markus Metz
+# PURPOSE:      Check that the category index written by v.rmarea is the
+#               same as the one built by v.build
+# COPYRIGHT:    (C) 2024 by the GRASS Development Team
+#
+#               This program is free software under the GNU General
+#               Public License (>=v2). Read the file COPYING that
+#               comes with GRASS for details.
+#
+############################################################################
+
+"""Test of the category index of the output of v.rmarea.
+
+Must be run in a GRASS session, e.g. with
+
+    grass --tmp-location XY --exec python3 cidx_test.py
+
+The category index of native output is updated while areas are merged,
+the category report of the output must not change when its topology is
+rebuilt with v.build. The input is a synthetic mosaic of the benchmark.
+"""
+
+import argparse
+import random
+import sys
+
+import grass.script as gs
+
+import benchmark
+
+
+def category_report(name):
+    return gs.read_command("v.category", input=name, option="report",
+                           quiet=True)
+
+
+def check(name, columns, thresh, **kwargs):
+    output = name + "_out"
+    gs.run_command("v.rmarea", input=name, output=output,
+                   columns=",".join(columns), threshold=thresh,
+                   overwrite=True, quiet=True, **kwargs)
+
+    written = category_report(output)
+    gs.run_command("v.build", map=output, quiet=True)
+    built = category_report(output)
+
+    gs.run_command("g.remove", type="vector", name=output, flags="f",
+                   quiet=True)
+
+    if written != built:
+        sys.stderr.write("Category index differs with %s\n" % kwargs)
+        sys.stderr.write("written:\n%s\nbuilt:\n%s\n" % (written, built))
+        return False
+
+    return True
+
+
+def main():
+    args = argparse.Namespace(mode="voronoi", slivers=0.1, isles=0.05,
+                              columns=1, cardinality=2)
+    rng = random.Random(1)
+    name, columns, thresh = benchmark.generate(args, 2000, rng)
+
+    ok = True
+    for kwargs in ({}, {"order": "size"}, {"nprocs": 4},
+                   {"flags": "f"}):
+        ok = check(name, columns, thresh, **kwargs) and ok
+
+    gs.run_command("g.remove", type="vector", name=name, flags="f",
+                   quiet=True)
+
+    if not ok:
+        gs.fatal("Category index of the output is not up to date")
+    gs.message("Category index test passed")
+
+
+if __name__ == "__main__":
+    main()
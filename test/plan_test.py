@@ -0,0 +1,115 @@
+#!/usr/bin/env python3
+
+############################################################################
+#
+# MODULE:       v.rmarea merge plan test
+# AUTHOR(S):    Markus Metz
+# PURPOSE:      Check that a merge plan saved with one output format can
+#               be loaded with another one
+# COPYRIGHT:    (C) 2024 by the GRASS Development Team
+#
+#               This program is free software under the GNU General
+#               Public License (>=v2). Read the file COPYING that
+#               comes with GRASS for details.
+#
+############################################################################
+
+"""Test of merge plans of v.rmarea with different output formats.
+
+Must be run in a GRASS session, e.g. with
+
+    grass --tmp-location XY --exec python3 plan_test.py
+
+A plan is saved with native output and loaded with GeoPackage output
+written with v.external.out, and the other way round. Both results must
+have the same areas as a run without plan.
+"""
+
+import argparse
+import os
+import random
+import shutil
+import sys
+import tempfile
+
+import grass.script as gs
+
+import benchmark
+
+
+def topology(name):
+    info = gs.parse_command("v.info", map=name, flags="t", quiet=True)
+    return {key: info[key] for key in ("areas", "centroids", "boundaries")}
+
+
+def remove(name):
+    gs.run_command("g.remove", type="vector", name=name, flags="f",
+                   quiet=True)
+
+
+def run(name, output, columns, thresh, ogr_dir=None, **kwargs):
+    """Run v.rmarea, with ogr_dir the output is written as GeoPackage"""
+    if ogr_dir:
+        gs.run_command("v.external.out", output=ogr_dir, format="GPKG",
+                       quiet=True)
+    try:
+        gs.run_command("v.rmarea", input=name, output=output,
+                       columns=",".join(columns), threshold=thresh,
+                       overwrite=True, quiet=True, **kwargs)
+    finally:
+        if ogr_dir:
+            gs.run_command("v.external.out", flags="r", quiet=True)
+
+    return topology(output)
+
+
+def check(name, columns, thresh, expected, tmpdir, save_ogr):
+    plan = os.path.join(tmpdir, "plan.bin")
+    ogr_dir = os.path.join(tmpdir, "gpkg")
+    saved = name + "_saved"
+    loaded = name + "_loaded"
+
+    run(name, saved, columns, thresh, ogr_dir if save_ogr else None,
+        save_plan=plan)
+    result = run(name, loaded, columns, thresh,
+                 None if save_ogr else ogr_dir, load_plan=plan)
+
+    remove(saved)
+    remove(loaded)
+    os.remove(plan)
+
+    if result != expected:
+        sys.stderr.write("Plan saved with %s output gives %s instead of "
+                         "%s\n" % ("GeoPackage" if save_ogr else "native",
+                                   result, expected))
+        return False
+
+    return True
+
+
+def main():
+    args = argparse.Namespace(mode="voronoi", slivers=0.1, isles=0.05,
+                              columns=1, cardinality=2)
+    rng = random.Random(1)
+    name, columns, thresh = benchmark.generate(args, 2000, rng)
+
+    expected = run(name, name + "_out", columns, thresh)
+    remove(name + "_out")
+
+    tmpdir = tempfile.mkdtemp()
+    try:
+        ok = True
+        for save_ogr in (False, True):
+            ok = check(name, columns, thresh, expected, tmpdir,
+                       save_ogr) and ok
+    finally:
+        shutil.rmtree(tmpdir)
+        remove(name)
+
+    if not ok:
+        gs.fatal("Merge plans depend on the output format")
+    gs.message("Merge plan test passed")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,320 @@
+/***************************************************************
+ *
+ * MODULE:       v.rmarea
+ *
+ * AUTHOR(S):    Markus Metz
+ *
+ * PURPOSE:      Thresholds of categories from an attribute column or
+ *               from rules
+ *
+ * COPYRIGHT:    (C) 2024 by the GRASS Development Team
+ *
+ *               This program is free software under the
+ *               GNU General Public License (>=v2).
+ *               Read the file COPYING that comes with GRASS
+ *               for details.
+ *
+ **************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <grass/gis.h>
+#include <grass/vector.h>
+#include <grass/dbmi.h>
+#include <grass/glocale.h>
+
+#include "proto.h"
+
+/* a rule assigns a threshold to a value of a column */
+struct rule {
+    char *value;
+    int ival;   /* value parsed for integer columns */
+    double dval; /* value parsed for double columns */
+    double thresh;
+    int line; /* order in the file, the first rule of a value wins */
+};
+
+/* read rules "value = threshold", one per line, # starts a comment */
+static struct rule *read_rules(const char *file, int *nrules)
+{
+    FILE *fp;
+    char buf[GPATH_MAX], *eq, *value, *end;
+    struct rule *rules;
+    int n, alloc, line;
+
+    if (!(fp = fopen(file, "r")))
+        G_fatal_error(_("Unable to open file <%s>"), file);
+
+    rules = NULL;
+    n = alloc = 0;
+    line = 0;
+    while (G_getl2(buf, sizeof(buf), fp)) {
+        line++;
+        if ((eq = strchr(buf, '#')))
+            *eq = '\0';
+        G_strip(buf);
+        if (!*buf)
+            continue;
+
+        if (!(eq = strchr(buf, '=')))
+            G_fatal_error(_("Missing '=' in line %d of rules <%s>"), line,
+                          file);
+        *eq = '\0';
+        value = buf;
+        G_strip(value);
+        G_strip(eq + 1);
+
+        if (n == alloc) {
+            alloc += 20;
+            rules = G_realloc(rules, alloc * sizeof(struct rule));
+        }
+        rules[n].value = G_store(value);
+        rules[n].line = n;
+        rules[n].thresh = strtod(eq + 1, &end);
+        if (end == eq + 1 || *end)
+            G_fatal_error(_("Invalid threshold <%s> in line %d of rules "
+                            "<%s>"),
+                          eq + 1, line, file);
+        n++;
+    }
+    fclose(fp);
+
+    *nrules = n;
+
+    return rules;
+}
+
+/* parse the values of the rules once for the type of the column */
+static void parse_rules(struct rule *rules, int nrules, int ctype,
+                        const char *file)
+{
+    char *end;
+    long l;
+    int i;
+
+    for (i = 0; i < nrules; i++) {
+        switch (ctype) {
+        case DB_C_TYPE_INT:
+            l = strtol(rules[i].value, &end, 10);
+            if (end == rules[i].value || *end || l < -2147483647L - 1 ||
+                l > 2147483647L)
+                G_fatal_error(_("Invalid integer value <%s> in rules <%s>"),
+                              rules[i].value, file);
+            rules[i].ival = (int)l;
+            break;
+        case DB_C_TYPE_DOUBLE:
+            rules[i].dval = strtod(rules[i].value, &end);
+            if (end == rules[i].value || *end)
+                G_fatal_error(_("Invalid number <%s> in rules <%s>"),
+                              rules[i].value, file);
+            break;
+        case DB_C_TYPE_STRING:
+            break;
+        default:
+            G_fatal_error(_("Unsupported column type of rules <%s>"), file);
+        }
+    }
+}
+
+static int rule_ctype;
+
+static int cmp_rule_value(const struct rule *a, const struct rule *b)
+{
+    switch (rule_ctype) {
+    case DB_C_TYPE_INT:
+        return (a->ival > b->ival) - (a->ival < b->ival);
+    case DB_C_TYPE_DOUBLE:
+        return (a->dval > b->dval) - (a->dval < b->dval);
+    default:
+        return strcmp(a->value, b->value);
+    }
+}
+
+static int cmp_rule_key(const void *pa, const void *pb)
+{
+    return cmp_rule_value(pa, pb);
+}
+
+static int cmp_rule(const void *pa, const void *pb)
+{
+    const struct rule *a = pa, *b = pb;
+    int ret = cmp_rule_value(a, b);
+
+    return ret ? ret : a->line - b->line;
+}
+
+/* sort the rules by value and keep only the first rule of each value */
+static int sort_rules(struct rule *rules, int nrules, int ctype)
+{
+    int i, n;
+
+    rule_ctype = ctype;
+    qsort(rules, nrules, sizeof(struct rule), cmp_rule);
+
+    n = 0;
+    for (i = 0; i < nrules; i++) {
+        if (n > 0 && cmp_rule_value(&rules[n - 1], &rules[i]) == 0) {
+            G_free(rules[i].value);
+            continue;
+        }
+        rules[n++] = rules[i];
+    }
+
+    return n;
+}
+
+/* find the rule of a value, return NULL if none */
+static const struct rule *find_rule(const struct rule *rules, int nrules,
+                                    const dbCatVal *val, int ctype)
+{
+    struct rule key;
+
+    switch (ctype) {
+    case DB_C_TYPE_INT:
+        key.ival = val->val.i;
+        break;
+    case DB_C_TYPE_DOUBLE:
+        key.dval = val->val.d;
+        break;
+    default:
+        key.value = (char *)db_get_string(val->val.s);
+        break;
+    }
+    key.line = 0;
+    rule_ctype = ctype;
+
+    return bsearch(&key, rules, nrules, sizeof(struct rule), cmp_rule_key);
+}
+
+/*!
+   \brief Load the thresholds of all categories of a layer
+
+   Either column or rules must be given. Values of column are thresholds,
+   with rules the thresholds are assigned to the values of rules_column.
+   Categories without threshold use the default threshold.
+
+   \param[out] ct thresholds of categories
+   \param Fi database connection of the layer
+   \param column numeric column with thresholds or NULL
+   \param rules name of the rules file or NULL
+   \param rules_column column the values of the rules refer to
+   \param def default threshold
+ */
+void cat_thresholds_load(struct cat_thresholds *ct,
+                         const struct field_info *Fi, const char *column,
+                         const char *rules, const char *rules_column,
+                         double def)
+{
+    dbDriver *driver;
+    dbCatValArray cvarr;
+    struct rule *rule_list = NULL;
+    int i, nrules = 0;
+    const char *colname;
+
+    colname = column;
+    if (rules) {
+        rule_list = read_rules(rules, &nrules);
+        colname = rules_column;
+    }
+
+    driver = db_start_driver_open_database(Fi->driver, Fi->database);
+    if (!driver)
+        G_fatal_error(_("Unable to open database <%s> with driver <%s>"),
+                      Fi->database, Fi->driver);
+
+    db_CatValArray_init(&cvarr);
+    if (db_select_CatValArray(driver, Fi->table, Fi->key, colname, NULL,
+                              &cvarr) < 0)
+        G_fatal_error(_("Unable to select data from table <%s>"), Fi->table);
+    db_close_database_shutdown_driver(driver);
+
+    if (!rules && cvarr.ctype != DB_C_TYPE_INT &&
+        cvarr.ctype != DB_C_TYPE_DOUBLE)
+        G_fatal_error(_("Column <%s> is not numeric"), column);
+
+    if (rules) {
+        parse_rules(rule_list, nrules, cvarr.ctype, rules);
+        nrules = sort_rules(rule_list, nrules, cvarr.ctype);
+    }
+
+    ct->n = 0;
+    ct->cat = G_malloc((cvarr.n_values + 1) * sizeof(int));
+    ct->thresh = G_malloc((cvarr.n_values + 1) * sizeof(double));
+    ct->max = def;
+
+    /* values are sorted by category */
+    for (i = 0; i < cvarr.n_values; i++) {
+        dbCatVal *val = &cvarr.value[i];
+        double thresh;
+
+        if (val->isNull)
+            continue;
+        if (rules) {
+            const struct rule *r;
+
+            if (!(r = find_rule(rule_list, nrules, val, cvarr.ctype)))
+                continue;
+            thresh = r->thresh;
+        }
+        else if (cvarr.ctype == DB_C_TYPE_INT)
+            thresh = val->val.i;
+        else
+            thresh = val->val.d;
+
+        ct->cat[ct->n] = val->cat;
+        ct->thresh[ct->n] = thresh;
+        ct->n++;
+        if (ct->max < thresh)
+            ct->max = thresh;
+    }
+    db_CatValArray_free(&cvarr);
+
+    for (i = 0; i < nrules; i++)
+        G_free(rule_list[i].value);
+    G_free(rule_list);
+
+    G_verbose_message(_("%d categories with own threshold, largest "
+                        "threshold %g"),
+                      ct->n, ct->max);
+}
+
+void cat_thresholds_free(struct cat_thresholds *ct)
+{
+    G_free(ct->cat);
+    G_free(ct->thresh);
+    ct->cat = NULL;
+    ct->thresh = NULL;
+    ct->n = 0;
+}
+
+/*!
+   \brief Get the threshold of an area
+
+   \param par settings
+   \param cat category of the area, -1 if none
+
+   \return threshold of the category or the default threshold
+ */
+double area_threshold(const struct rmarea_params *par, int cat)
+{
+    const struct cat_thresholds *ct = par->cat_thresh;
+    int lo, hi, mid;
+
+    if (!ct || cat < 0)
+        return par->thresh;
+
+    lo = 0;
+    hi = ct->n - 1;
+    while (lo <= hi) {
+        mid = (lo + hi) / 2;
+        if (ct->cat[mid] == cat)
+            return ct->thresh[mid];
+        if (ct->cat[mid] < cat)
+            lo = mid + 1;
+        else
+            hi = mid - 1;
+    }
+
+    return par->thresh;
+}
@@ -0,0 +1,71 @@
+/***************************************************************
+ *
+ * MODULE:       v.rmarea
+ *
+ * AUTHOR(S):    Markus Metz
+ *
+ * PURPOSE:      Wall time of the phases of a run
+ *
+ * COPYRIGHT:    (C) 2024 by the GRASS Development Team
+ *
+ *               This program is free software under the
+ *               GNU General Public License (>=v2).
+ *               Read the file COPYING that comes with GRASS
+ *               for details.
+ *
+ **************************************************************/
+#include <sys/time.h>
+
+#include <grass/gis.h>
+#include <grass/vector.h>
+#include <grass/glocale.h>
+
+#include "proto.h"
+
+/* Phases may be started and stopped several times, times are summed up. */
+
+static const char *names[N_PHASES] = {
+    "attributes", "copy", "remove", "merge_lines", "write", "build",
+    "copy_tabs", "total"};
+static double start[N_PHASES];
+static double elapsed[N_PHASES];
+
+/* wall time in seconds */
+double timer_now(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+void phase_start(int phase)
+{
+    start[phase] = timer_now();
+}
+
+void phase_stop(int phase)
+{
+    elapsed[phase] += timer_now() - start[phase];
+}
+
+double phase_time(int phase)
+{
+    return elapsed[phase];
+}
+
+const char *phase_name(int phase)
+{
+    return names[phase];
+}
+
+/* print the time of all phases as verbose messages */
+void phase_report(void)
+{
+    int phase;
+
+    for (phase = 0; phase < N_PHASES; phase++)
+        G_verbose_message(_("Time for %s: %.3f s"), names[phase],
+                          elapsed[phase]);
+}
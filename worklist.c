@@ -0,0 +1,179 @@
+/***************************************************************
+ *
+ * MODULE:       v.rmarea
+ *
+ * AUTHOR(S):    Markus Metz
+ *
+ * PURPOSE:      Queue of areas still to be checked for removal
+ *
+ * COPYRIGHT:    (C) 2024 by the GRASS Development Team
+ *
+ *               This program is free software under the
+ *               GNU General Public License (>=v2).
+ *               Read the file COPYING that comes with GRASS
+ *               for details.
+ *
+ **************************************************************/
+#include <string.h>
+
+#include <grass/gis.h>
+#include <grass/vector.h>
+
+#include "proto.h"
+
+/* The queue is either first in first out, or a binary min heap on
+ * (key, area) if areas are ordered by key. */
+
+void worklist_init(struct worklist *wl, int by_key)
+{
+    wl->items = NULL;
+    wl->key = NULL;
+    wl->head = wl->tail = wl->alloc = 0;
+    wl->by_key = by_key;
+    wl->pos = NULL;
+    wl->alloc_pos = 0;
+}
+
+void worklist_free(struct worklist *wl)
+{
+    if (wl->items)
+        G_free(wl->items);
+    if (wl->key)
+        G_free(wl->key);
+    if (wl->pos)
+        G_free(wl->pos);
+    worklist_init(wl, wl->by_key);
+}
+
+int worklist_size(const struct worklist *wl)
+{
+    return wl->tail - wl->head;
+}
+
+/* heap order: smaller key first, equal keys by area id */
+static int heap_less(const struct worklist *wl, int i, int j)
+{
+    if (wl->key[i] != wl->key[j])
+        return wl->key[i] < wl->key[j];
+
+    return wl->items[i] < wl->items[j];
+}
+
+static void heap_swap(struct worklist *wl, int i, int j)
+{
+    int area;
+    double key;
+
+    area = wl->items[i];
+    wl->items[i] = wl->items[j];
+    wl->items[j] = area;
+    key = wl->key[i];
+    wl->key[i] = wl->key[j];
+    wl->key[j] = key;
+
+    wl->pos[wl->items[i]] = i;
+    wl->pos[wl->items[j]] = j;
+}
+
+static void heap_up(struct worklist *wl, int i)
+{
+    while (i > 0 && heap_less(wl, i, (i - 1) / 2)) {
+        heap_swap(wl, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+static void heap_down(struct worklist *wl, int i)
+{
+    int child;
+
+    while ((child = 2 * i + 1) < wl->tail) {
+        if (child + 1 < wl->tail && heap_less(wl, child + 1, child))
+            child++;
+        if (!heap_less(wl, child, i))
+            break;
+        heap_swap(wl, i, child);
+        i = child;
+    }
+}
+
+/* add an area to the queue,
+ * areas already waiting in the queue are not added again,
+ * but their key is updated */
+void worklist_push(struct worklist *wl, int area, double key)
+{
+    int i;
+
+    if (area <= 0)
+        return;
+
+    if (area >= wl->alloc_pos) {
+        int alloc = wl->alloc_pos;
+
+        wl->alloc_pos = area + 1000 + wl->alloc_pos / 2;
+        wl->pos = G_realloc(wl->pos, wl->alloc_pos * sizeof(int));
+        for (i = alloc; i < wl->alloc_pos; i++)
+            wl->pos[i] = -1;
+    }
+    if (wl->pos[area] >= 0) {
+        if (wl->by_key && wl->key[wl->pos[area]] != key) {
+            i = wl->pos[area];
+            wl->key[i] = key;
+            heap_up(wl, i);
+            heap_down(wl, wl->pos[area]);
+        }
+        return;
+    }
+
+    if (wl->tail >= wl->alloc) {
+        /* reuse space of already processed areas before growing */
+        if (!wl->by_key && wl->head > wl->alloc / 2) {
+            memmove(wl->items, wl->items + wl->head,
+                    (wl->tail - wl->head) * sizeof(int));
+            wl->tail -= wl->head;
+            wl->head = 0;
+        }
+        else {
+            wl->alloc = wl->alloc + 1000 + wl->alloc / 2;
+            wl->items = G_realloc(wl->items, wl->alloc * sizeof(int));
+            if (wl->by_key)
+                wl->key = G_realloc(wl->key, wl->alloc * sizeof(double));
+        }
+    }
+    i = wl->tail++;
+    wl->items[i] = area;
+    wl->pos[area] = i;
+    if (wl->by_key) {
+        wl->key[i] = key;
+        heap_up(wl, i);
+    }
+}
+
+/* get the next area from the queue
+ * return 0 if the queue is empty */
+int worklist_pop(struct worklist *wl)
+{
+    int area;
+
+    if (wl->head >= wl->tail)
+        return 0;
+
+    if (!wl->by_key) {
+        area = wl->items[wl->head++];
+        wl->pos[area] = -1;
+
+        return area;
+    }
+
+    area = wl->items[0];
+    wl->tail--;
+    if (wl->tail > 0) {
+        wl->items[0] = wl->items[wl->tail];
+        wl->key[0] = wl->key[wl->tail];
+        wl->pos[wl->items[0]] = 0;
+        heap_down(wl, 0);
+    }
+    wl->pos[area] = -1;
+
+    return area;
+}